@@ -22,6 +22,7 @@
 #include <setjmp.h>
 #include <math.h>
 #include "btest.h"
+#include "benchenv.h"
 
 /* Not declared in some stdlib.h files, so define here */
 float strtof(const char *nptr, char **endptr);
@@ -74,6 +75,10 @@ static unsigned argval[3] = {0,0,0};
 /* Use fixed weight for rating, and if so, what should it  be? (-r) */
 static int global_rating = 0;
 
+/* Pin to this CPU (-C) and run under SCHED_FIFO (-F) */
+static int pin_cpu = -1;
+static int fifo = 0;
+
 /******************
  * Helper functions
  ******************/
@@ -529,10 +534,12 @@ static int get_num_val(char *sval, unsigned *valp) {
  * usage - Display usage info
  */
 static void usage(char *cmd) {
-    printf("Usage: %s [-hg] [-r <n>] [-f <name> [-1|-2|-3 <val>]*] [-T <time limit>]\n", cmd);
+    printf("Usage: %s [-hgF] [-r <n>] [-f <name> [-1|-2|-3 <val>]*] [-T <time limit>] [-C <cpu>]\n", cmd);
     printf("  -1 <val>  Specify first function argument\n");
     printf("  -2 <val>  Specify second function argument\n");
     printf("  -3 <val>  Specify third function argument\n");
+    printf("  -C <cpu>  Pin to CPU <cpu>\n");
+    printf("  -F        Run under SCHED_FIFO (needs root or CAP_SYS_NICE)\n");
     printf("  -f <name> Test only the named function\n");
     printf("  -g        Compact output for grading (with no error msgs)\n");
     printf("  -h        Print this message\n");
@@ -549,9 +556,10 @@ static void usage(char *cmd) {
 int main(int argc, char *argv[])
 {
     char c;
+    benchenv_t env;
 
     /* parse command line args */
-    while ((c = getopt(argc, argv, "hgf:r:T:1:2:3:")) != -1)
+    while ((c = getopt(argc, argv, "hgf:r:T:1:2:3:C:F")) != -1)
         switch (c) {
         case 'h': /* help */
 	    usage(argv[0]);
@@ -591,6 +599,12 @@ int main(int argc, char *argv[])
 	case 'T': /* Set timeout limit */
 	    timeout_limit = atoi(optarg);
 	    break;
+	case 'C': /* Pin to one CPU */
+	    pin_cpu = atoi(optarg);
+	    break;
+	case 'F': /* Run under the real-time scheduler */
+	    fifo = 1;
+	    break;
 	default:
 	    usage(argv[0]);
 	}
@@ -599,6 +613,20 @@ int main(int argc, char *argv[])
 	Signal(SIGALRM, timeout_handler);
     }
 
+    /* Pin down where we run, and report it unless grading */
+    benchenv_init(&env);
+    if (pin_cpu >= 0 && benchenv_pin(&env, pin_cpu) < 0) {
+	printf("Could not pin to CPU %d\n", pin_cpu);
+	exit(1);
+    }
+    if (fifo && benchenv_fifo(&env) < 0)
+	printf("Warning: could not switch to SCHED_FIFO\n");
+    benchenv_probe(&env);
+    if (!grade) {
+	benchenv_print(&env, stdout);
+	benchenv_warn(&env, stdout);
+    }
+
     /* test each function */
     run_tests();
 
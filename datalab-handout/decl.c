@@ -29,5 +29,7 @@ test_rec test_set[] = {
   {{TMin, TMax},{TMin,TMax},{TMin,TMax}}},
 //7
  {"floatFloat2Int", (funct_t) floatFloat2Int, (funct_t) test_floatFloat2Int, 1,
-    "$", 30, 4, {{1, 1},{1,1},{1,1}}}
+    "$", 30, 4, {{1, 1},{1,1},{1,1}}},
+  {"", NULL, NULL, 0, "", 0, 0,
+   {{0, 0},{0,0},{0,0}}}
 };
@@ -0,0 +1,133 @@
+/*
+ * allocator.c - A malloc package behind a table of function pointers
+ *
+ * A dlopen'd allocator is opened with RTLD_LOCAL, so its malloc only
+ * serves the blocks we ask it for; everything else in the process
+ * (stdio, the driver's own buffers) keeps using the C library's.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <malloc.h>
+#include <dlfcn.h>
+
+#include "allocator.h"
+#include "mm.h"
+#include "memlib.h"
+
+/*
+ * mm_start - Give mm.c an empty simulated heap
+ */
+static int mm_start(void) {
+    mem_reset_brk();
+    return mm_init();
+}
+
+static int mm_posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if ((*ptr = mm_memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    return 0;
+}
+
+static size_t mm_heap_size(void) {
+    return mem_heapsize();
+}
+
+/*
+ * open_library - dlopen spec, or if it isn't a path, the usual file
+ *     names of a library called spec
+ */
+static void *open_library(const char *spec) {
+    static const char *patterns[] = {
+        "%s", "lib%s.so", "lib%s.so.2", "lib%s.so.4", NULL
+    };
+    char file[256];
+    void *handle;
+    int i;
+
+    for (i = 0; patterns[i]; i++) {
+        if (i > 0 && strchr(spec, '/'))
+            break;
+        snprintf(file, sizeof(file), patterns[i], spec);
+        if ((handle = dlopen(file, RTLD_NOW | RTLD_LOCAL)) != NULL)
+            return handle;
+    }
+    return NULL;
+}
+
+/*
+ * allocator_open - Fill in the function table for spec
+ */
+allocator_t *allocator_open(const char *spec) {
+    allocator_t *a;
+    const char *base;
+
+    if ((a = calloc(1, sizeof(allocator_t))) == NULL)
+        return NULL;
+
+    if (strcmp(spec, "mm") == 0) {
+        a->init = mm_start;
+        a->malloc = mm_malloc;
+        a->free = mm_free;
+        a->realloc = mm_realloc;
+        a->calloc = mm_calloc;
+        a->posix_memalign = mm_posix_memalign;
+        a->usable_size = mm_usable_size;
+        a->heap_size = mm_heap_size;
+    } else if (strcmp(spec, "libc") == 0) {
+        a->malloc = malloc;
+        a->free = free;
+        a->realloc = realloc;
+        a->calloc = calloc;
+        a->posix_memalign = posix_memalign;
+        a->usable_size = malloc_usable_size;
+    } else {
+        if ((a->handle = open_library(spec)) == NULL) {
+            fprintf(stderr, "Could not load allocator %s: %s\n", spec, dlerror());
+            free(a);
+            return NULL;
+        }
+        a->malloc = dlsym(a->handle, "malloc");
+        a->free = dlsym(a->handle, "free");
+        a->realloc = dlsym(a->handle, "realloc");
+        a->calloc = dlsym(a->handle, "calloc");
+        a->posix_memalign = dlsym(a->handle, "posix_memalign");
+        a->usable_size = dlsym(a->handle, "malloc_usable_size");
+        if (!a->malloc || !a->free || !a->realloc || !a->calloc ||
+            !a->posix_memalign) {
+            fprintf(stderr, "%s does not export the malloc API\n", spec);
+            allocator_close(a);
+            return NULL;
+        }
+    }
+
+    /*
+     * Name a short name after the library, without the lib prefix. A
+     * path keeps its name as given, so that /lib/.../libc.so.6 isn't
+     * taken for the built-in libc, nor two builds of one library for
+     * each other.
+     */
+    if (strchr(spec, '/')) {
+        snprintf(a->name, sizeof(a->name), "%s", spec);
+        return a;
+    }
+    base = spec;
+    if (strncmp(base, "lib", 3) == 0 && isalnum(base[3]) && isalnum(base[4]))
+        base += 3;
+    snprintf(a->name, sizeof(a->name), "%s", base);
+    if (strchr(a->name, '.'))
+        *strchr(a->name, '.') = '\0';
+    return a;
+}
+
+/*
+ * allocator_close - Unload a dlopen'd allocator and free the table
+ */
+void allocator_close(allocator_t *alloc) {
+    if (alloc->handle)
+        dlclose(alloc->handle);
+    free(alloc);
+}
@@ -0,0 +1,38 @@
+/*
+ * allocator.h - A malloc package behind a table of function pointers
+ *
+ * Lets mdriver replay the same trace against mm.c, the C library's
+ * malloc, or any malloc package it can dlopen (a local jemalloc or
+ * tcmalloc build, say).
+ */
+#ifndef __ALLOCATOR_H
+#define __ALLOCATOR_H
+
+#include <stddef.h>
+
+typedef struct {
+    char name[64];
+    int (*init)(void);           /* start from an empty heap; may be NULL */
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    int (*posix_memalign)(void **ptr, size_t alignment, size_t size);
+    size_t (*usable_size)(void *ptr); /* bytes usable at ptr; may be NULL */
+    size_t (*heap_size)(void);   /* bytes of heap in use; may be NULL */
+    void *handle;                /* from dlopen, or NULL */
+} allocator_t;
+
+/*
+ * Open an allocator: "mm" for mm.c, "libc" for the malloc this process
+ * was linked with (or LD_PRELOADed), or else a shared library to
+ * dlopen, given as a path or as a short name like "jemalloc" (tried as
+ * libjemalloc.so, libjemalloc.so.2, ...). Returns NULL and prints why
+ * if the allocator can't be opened.
+ */
+allocator_t *allocator_open(const char *spec);
+
+/* Release an allocator from allocator_open */
+void allocator_close(allocator_t *alloc);
+
+#endif /* __ALLOCATOR_H */
@@ -0,0 +1,179 @@
+/*
+ * benchenv.c - Pin a benchmark down so its results reproduce
+ *
+ * Clock-rate changes are the biggest source of run-to-run noise on an
+ * otherwise idle machine: a governor other than "performance" lets the
+ * clock ramp up and down under the benchmark, and turbo makes the
+ * clock depend on temperature and on what the other cores are doing.
+ * We can't change either without root, so we just report them.
+ */
+#define _GNU_SOURCE    /* for sched_setaffinity() and sched_getcpu() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "benchenv.h"
+
+/*
+ * read_line - Read the first line of a sysfs file into buf, without
+ *     the newline. Returns 0 if the file can't be read.
+ */
+static int read_line(const char *path, char *buf, int size) {
+    FILE *fp;
+    char *nl;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+    if (fgets(buf, size, fp) == NULL) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    if ((nl = strchr(buf, '\n')) != NULL)
+        *nl = '\0';
+    return 1;
+}
+
+/*
+ * read_long - Read a number from a sysfs file; def if there is none
+ */
+static long read_long(const char *path, long def) {
+    char buf[64];
+
+    return read_line(path, buf, sizeof(buf)) ? atol(buf) : def;
+}
+
+/*
+ * benchenv_init - Start out unpinned, under the default scheduler,
+ *     with nothing known about the clock
+ */
+void benchenv_init(benchenv_t *env) {
+    memset(env, 0, sizeof(*env));
+    env->cpu = -1;
+    env->turbo = -1;
+}
+
+/*
+ * benchenv_pin - Pin the calling process to cpu
+ */
+int benchenv_pin(benchenv_t *env, int cpu) {
+    cpu_set_t mask;
+
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) < 0)
+        return -1;
+    env->cpu = cpu;
+    return 0;
+}
+
+/*
+ * benchenv_fifo - Run under SCHED_FIFO, one below the top priority so
+ *     that the kernel's own real-time threads can still preempt us.
+ *     Usually needs root or CAP_SYS_NICE.
+ */
+int benchenv_fifo(benchenv_t *env) {
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+        return -1;
+    env->fifo = 1;
+    return 0;
+}
+
+/*
+ * benchenv_probe - Read the cpufreq state of the CPU we are on (or
+ *     pinned to) and whether turbo is enabled. intel_pstate reports
+ *     turbo as no_turbo; acpi-cpufreq and amd-pstate report it as
+ *     cpufreq/boost.
+ */
+void benchenv_probe(benchenv_t *env) {
+    char path[128];
+    long v;
+    int cpu = (env->cpu >= 0) ? env->cpu : sched_getcpu();
+
+    if (cpu < 0)
+        cpu = 0;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+    if (!read_line(path, env->governor, sizeof(env->governor)))
+        env->governor[0] = '\0';
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    env->cur_khz = read_long(path, 0);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_min_freq", cpu);
+    env->min_khz = read_long(path, 0);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    env->max_khz = read_long(path, 0);
+
+    if ((v = read_long("/sys/devices/system/cpu/intel_pstate/no_turbo", -1)) >= 0)
+        env->turbo = !v;
+    else
+        env->turbo = read_long("/sys/devices/system/cpu/cpufreq/boost", -1);
+}
+
+/*
+ * benchenv_warn - Warn about anything likely to make timings noisy
+ */
+int benchenv_warn(benchenv_t *env, FILE *fp) {
+    int n = 0;
+
+    if (env->governor[0] && strcmp(env->governor, "performance") != 0) {
+        fprintf(fp, "Warning: the cpufreq governor is \"%s\", not "
+                "\"performance\"; the clock may change during the run\n",
+                env->governor);
+        n++;
+    }
+    if (env->turbo == 1) {
+        fprintf(fp, "Warning: turbo boost is on; the clock depends on "
+                "temperature and load\n");
+        n++;
+    }
+    return n;
+}
+
+/*
+ * benchenv_print - Print a one-line summary
+ */
+void benchenv_print(benchenv_t *env, FILE *fp) {
+    fprintf(fp, "Environment: ");
+    if (env->cpu >= 0)
+        fprintf(fp, "pinned to CPU %d", env->cpu);
+    else
+        fprintf(fp, "not pinned");
+    fprintf(fp, ", %s", env->fifo ? "SCHED_FIFO" : "SCHED_OTHER");
+    fprintf(fp, ", governor %s", env->governor[0] ? env->governor : "unknown");
+    fprintf(fp, ", turbo %s", (env->turbo < 0) ? "unknown" :
+            env->turbo ? "on" : "off");
+    if (env->max_khz > 0)
+        fprintf(fp, ", %.0f-%.0f MHz (now %.0f)", env->min_khz / 1e3,
+                env->max_khz / 1e3, env->cur_khz / 1e3);
+    fprintf(fp, "\n");
+}
+
+/*
+ * benchenv_json - Write the environment as a JSON object, with null
+ *     for what we don't know
+ */
+void benchenv_json(benchenv_t *env, FILE *fp) {
+    fprintf(fp, "{\"cpu\": ");
+    if (env->cpu >= 0)
+        fprintf(fp, "%d", env->cpu);
+    else
+        fprintf(fp, "null");
+    fprintf(fp, ", \"sched_fifo\": %s, \"governor\": ",
+            env->fifo ? "true" : "false");
+    if (env->governor[0])
+        fprintf(fp, "\"%s\"", env->governor);
+    else
+        fprintf(fp, "null");
+    fprintf(fp, ", \"turbo\": %s", (env->turbo < 0) ? "null" :
+            env->turbo ? "true" : "false");
+    if (env->max_khz > 0)
+        fprintf(fp, ", \"cur_khz\": %ld, \"min_khz\": %ld, \"max_khz\": %ld",
+                env->cur_khz, env->min_khz, env->max_khz);
+    else
+        fprintf(fp, ", \"cur_khz\": null, \"min_khz\": null, \"max_khz\": null");
+    fprintf(fp, "}");
+}
@@ -0,0 +1,45 @@
+/*
+ * benchenv.h - Pin a benchmark down so its results reproduce
+ *
+ * Pins the process to one CPU, optionally raises it to SCHED_FIFO, and
+ * reads the frequency-scaling state of that CPU from sysfs so that the
+ * results can record it (and warn when it is likely to add noise).
+ */
+#ifndef __BENCHENV_H
+#define __BENCHENV_H
+
+#include <stdio.h>
+
+typedef struct {
+    int cpu;            /* CPU we are pinned to, or -1 if not pinned */
+    int fifo;           /* running under SCHED_FIFO? */
+    char governor[32];  /* cpufreq governor of our CPU; "" if unknown */
+    int turbo;          /* 1 if turbo/boost is on, 0 if off, -1 if unknown */
+    long cur_khz;       /* current, min and max clock of our CPU, */
+    long min_khz;       /* or 0 where sysfs doesn't say */
+    long max_khz;
+} benchenv_t;
+
+/* Start with nothing pinned or known */
+void benchenv_init(benchenv_t *env);
+
+/* Pin the calling process to cpu; -1 (with errno set) on failure */
+int benchenv_pin(benchenv_t *env, int cpu);
+
+/* Switch to SCHED_FIFO just below the top priority; -1 on failure */
+int benchenv_fifo(benchenv_t *env);
+
+/* Fill in the frequency-scaling fields for the CPU we are on */
+void benchenv_probe(benchenv_t *env);
+
+/* Print a warning for each setting that makes timings noisy; return
+   how many there were */
+int benchenv_warn(benchenv_t *env, FILE *fp);
+
+/* Print a one-line summary */
+void benchenv_print(benchenv_t *env, FILE *fp);
+
+/* Write the environment as a JSON object */
+void benchenv_json(benchenv_t *env, FILE *fp);
+
+#endif /* __BENCHENV_H */
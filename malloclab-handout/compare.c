@@ -0,0 +1,256 @@
+/*
+ * compare.c - Reading baseline results and comparing benchmark samples
+ *
+ * read_baseline() is not a general JSON parser. It understands the
+ * files that mdriver --json writes: an "mm" object holding a "traces"
+ * array of flat objects whose only nested values are arrays of numbers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "compare.h"
+
+/* Skip whitespace */
+static char *skip_space(char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+        s++;
+    return s;
+}
+
+/*
+ * find_value - Find "key": between s and end and return a pointer to
+ *     its value, or NULL if the key isn't there.
+ */
+static char *find_value(char *s, char *end, char *key) {
+    char pattern[COMPARE_MAXNAME + 3];
+    char *p;
+
+    sprintf(pattern, "\"%s\"", key);
+    for (p = strstr(s, pattern); p && p < end; p = strstr(p + 1, pattern)) {
+        p = skip_space(p + strlen(pattern));
+        if (*p == ':')
+            return skip_space(p + 1);
+    }
+    return NULL;
+}
+
+/*
+ * object_end - Given a pointer to '{' or '[', return a pointer to the
+ *     matching close bracket, or NULL if there isn't one.
+ */
+static char *object_end(char *s) {
+    int depth = 0;
+    int in_string = 0;
+
+    for (; *s; s++) {
+        if (in_string) {
+            if (*s == '\\' && s[1])
+                s++;
+            else if (*s == '"')
+                in_string = 0;
+        } else if (*s == '"') {
+            in_string = 1;
+        } else if (*s == '{' || *s == '[') {
+            depth++;
+        } else if (*s == '}' || *s == ']') {
+            if (--depth == 0)
+                return s;
+        }
+    }
+    return NULL;
+}
+
+/* Parse one trace object between s and end into b */
+static int parse_trace(char *s, char *end, baseline_t *b) {
+    char *v, *q;
+    int n;
+
+    memset(b, 0, sizeof(baseline_t));
+    if ((v = find_value(s, end, "file")) == NULL || *v != '"')
+        return 0;
+    if ((q = strchr(v + 1, '"')) == NULL ||
+        (n = (int)(q - v - 1)) >= COMPARE_MAXNAME)
+        return 0;
+    strncpy(b->file, v + 1, n);
+    b->file[n] = '\0';
+
+    if ((v = find_value(s, end, "valid")) != NULL)
+        b->valid = (strncmp(v, "true", 4) == 0);
+    if ((v = find_value(s, end, "util")) != NULL)
+        b->util = strtod(v, NULL);
+
+    if ((v = find_value(s, end, "kops_samples")) != NULL && *v == '[') {
+        v++;
+        while (b->nsamples < COMPARE_MAXRUNS) {
+            v = skip_space(v);
+            if (*v == ']')
+                break;
+            b->kops[b->nsamples++] = strtod(v, &q);
+            if (q == v)
+                return 0;
+            v = skip_space(q);
+            if (*v == ',')
+                v++;
+        }
+    } else if ((v = find_value(s, end, "kops")) != NULL) {
+        b->kops[b->nsamples++] = strtod(v, NULL);
+    }
+    return 1;
+}
+
+/*
+ * read_baseline - Read the mm results of a JSON file written by mdriver
+ *     --json into a malloc'd array. Returns the number of traces, or -1
+ *     if the file can't be read or isn't in the expected format.
+ */
+int read_baseline(char *filename, baseline_t **traces) {
+    FILE *fp;
+    long len;
+    char *buf, *s, *end, *obj_end;
+    baseline_t *grown;
+    int n = 0, cap = 16;
+
+    if ((fp = fopen(filename, "r")) == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    if ((buf = malloc(len + 1)) == NULL || fread(buf, 1, len, fp) != len) {
+        fclose(fp);
+        free(buf);
+        return -1;
+    }
+    buf[len] = '\0';
+    fclose(fp);
+
+    if ((s = find_value(buf, buf + len, "mm")) == NULL ||
+        (s = find_value(s, buf + len, "traces")) == NULL ||
+        *s != '[' || (end = object_end(s)) == NULL) {
+        free(buf);
+        return -1;
+    }
+
+    if ((*traces = malloc(cap * sizeof(baseline_t))) == NULL) {
+        free(buf);
+        return -1;
+    }
+    for (s = skip_space(s + 1); *s == '{'; s = skip_space(s)) {
+        if ((obj_end = object_end(s)) == NULL || obj_end > end)
+            break;
+        if (n == cap) {
+            cap *= 2;
+            if ((grown = realloc(*traces, cap * sizeof(baseline_t))) == NULL) {
+                n = -1;
+                break;
+            }
+            *traces = grown;
+        }
+        if (!parse_trace(s, obj_end, &(*traces)[n])) {
+            n = -1;
+            break;
+        }
+        n++;
+        s = skip_space(obj_end + 1);
+        if (*s == ',')
+            s++;
+    }
+    free(buf);
+    if (n < 0) {
+        free(*traces);
+        *traces = NULL;
+    }
+    return n;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - Return the median of the n values in x (x is left sorted)
+ */
+double median(double *x, int n) {
+    if (n == 0)
+        return 0.0;
+    qsort(x, n, sizeof(double), cmp_double);
+    return (n % 2) ? x[n/2] : (x[n/2 - 1] + x[n/2]) / 2.0;
+}
+
+/* A sample tagged with the group it came from, for ranking */
+typedef struct {
+    double value;
+    int group;
+} ranked_t;
+
+static int cmp_ranked(const void *a, const void *b) {
+    return cmp_double(&((const ranked_t *)a)->value,
+                      &((const ranked_t *)b)->value);
+}
+
+/*
+ * mann_whitney - Two-sided Mann-Whitney U test of whether samples x and
+ *     y come from the same distribution. Returns the p-value, using the
+ *     normal approximation with tie and continuity corrections.
+ */
+double mann_whitney(double *x, int nx, double *y, int ny) {
+    ranked_t *all;
+    int n = nx + ny;
+    int i, j, k;
+    double rank, rank_x = 0, ties = 0;
+    double u, mean, var, z;
+
+    if (nx == 0 || ny == 0)
+        return 1.0;
+    if ((all = malloc(n * sizeof(ranked_t))) == NULL)
+        return 1.0;
+    for (i = 0; i < nx; i++) {
+        all[i].value = x[i];
+        all[i].group = 0;
+    }
+    for (i = 0; i < ny; i++) {
+        all[nx + i].value = y[i];
+        all[nx + i].group = 1;
+    }
+    qsort(all, n, sizeof(ranked_t), cmp_ranked);
+
+    /* Tied values all get the average of the ranks they span */
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && all[j].value == all[i].value; j++)
+            ;
+        rank = (i + 1 + j) / 2.0;
+        for (k = i; k < j; k++)
+            if (all[k].group == 0)
+                rank_x += rank;
+        ties += (double)(j - i) * (j - i) * (j - i) - (j - i);
+    }
+    free(all);
+
+    u = rank_x - nx * (nx + 1) / 2.0;
+    mean = nx * ny / 2.0;
+    var = nx * ny / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0)
+        return 1.0;
+    z = (fabs(u - mean) - 0.5) / sqrt(var);
+    if (z < 0)
+        z = 0;
+    return erfc(z / sqrt(2.0));
+}
+
+/*
+ * mann_whitney_floor - The smallest p-value mann_whitney can return for
+ *     nx and ny samples: that of two sets with no values in common
+ */
+double mann_whitney_floor(int nx, int ny) {
+    double n = nx + ny;
+    double var = nx * ny * (n + 1) / 12.0;
+    double z;
+
+    if (nx == 0 || ny == 0)
+        return 1.0;
+    z = (nx * ny / 2.0 - 0.5) / sqrt(var);
+    return erfc(z / sqrt(2.0));
+}
@@ -0,0 +1,46 @@
+/*
+ * compare.h - Reading baseline results and comparing benchmark samples
+ */
+#ifndef __COMPARE_H
+#define __COMPARE_H
+
+
+#define COMPARE_MAXRUNS 32   /* max throughput samples per trace */
+#define COMPARE_MAXNAME 256  /* max trace file name length */
+#define COMPARE_MINRUNS 5    /* default samples per trace when writing or
+                                comparing against a baseline */
+
+/* The baseline results for one trace, as written by mdriver --json */
+typedef struct {
+    char file[COMPARE_MAXNAME];   /* trace file name */
+    int valid;                    /* was the trace processed correctly? */
+    double util;                  /* space utilization */
+    int nsamples;                 /* number of throughput samples */
+    double kops[COMPARE_MAXRUNS]; /* throughput samples in Kops */
+} baseline_t;
+
+/*
+ * read_baseline - Read the mm results of a JSON file written by mdriver
+ *     --json into a malloc'd array. Returns the number of traces, or -1
+ *     if the file can't be read or isn't in the expected format.
+ */
+int read_baseline(char *filename, baseline_t **traces);
+
+/* Return the median of the n values in x (x is left sorted) */
+double median(double *x, int n);
+
+/*
+ * mann_whitney - Two-sided Mann-Whitney U test of whether samples x and
+ *     y come from the same distribution. Returns the p-value, using the
+ *     normal approximation with tie and continuity corrections.
+ */
+double mann_whitney(double *x, int nx, double *y, int ny);
+
+/*
+ * mann_whitney_floor - The smallest p-value mann_whitney can return for
+ *     nx and ny samples (when the two sets don't overlap at all). With
+ *     too few samples this is above any useful significance level.
+ */
+double mann_whitney_floor(int nx, int ny);
+
+#endif /* __COMPARE_H */
@@ -56,15 +56,18 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Default maximum heap size in bytes (mdriver --max-heap overrides it)
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
 /*****************************************************************************
- * Set exactly one of these USE_xxx constants to "1" to select a timing method
+ * Set exactly one of these USE_xxx constants to "1" to select the default
+ * timing method (mdriver --timer picks another one at run time)
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
-#define USE_ITIMER 1   /* interval timer (any Unix box) */
-#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_FCYC      0 /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_ITIMER    0 /* interval timer (any Unix box) */
+#define USE_GETTOD    0 /* gettimeofday (any Unix box) */
+#define USE_MONOTONIC 0 /* clock_gettime(CLOCK_MONOTONIC_RAW) (Linux) */
+#define USE_TSC       1 /* invariant TSC, else CLOCK_MONOTONIC_RAW */
 
 #endif /* __CONFIG_H */
@@ -6,9 +6,25 @@
  *
  * Uses the cycle timer routines in clock.c to estimate the
  * the time in CPU cycles for a function f.
+ *
+ * Two sampling schemes are available. The default K-best scheme
+ * returns the smallest sample once the K smallest agree to within
+ * EPSILON. The robust scheme (set_fcyc_robust) instead does a few
+ * warmup runs, takes a fixed number of samples, drops outliers that
+ * are more than MAD_CUTOFF scaled median absolute deviations from
+ * the median, and returns the median of the rest, with a bootstrap
+ * confidence interval (see fcyc_interval).
+ *
+ * Before each sample the caches can be left alone, made cold (by
+ * walking a buffer twice the size of the last-level cache, as read
+ * from sysfs), made warm (by running f once, untimed), or the TLB
+ * made cold (by touching one line in each of many small pages).
  */
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <sys/times.h>
+#include <sys/mman.h>
 #include <stdio.h>
 
 #include "fcyc.h"
@@ -19,19 +35,43 @@
 #define MAXSAMPLES 20        /* Give up after MAXSAMPLES */
 #define EPSILON 0.01         /* K samples should be EPSILON of each other*/
 #define COMPENSATE 0         /* 1-> try to compensate for clock ticks */
-#define CLEAR_CACHE 0        /* Clear cache before running test function */
-#define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
-#define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define CACHE_MODE FCYC_CACHE_ASIS /* Cache state before each sample */
+#define CACHE_BYTES (1<<19)  /* Cache size if sysfs doesn't know it */
+#define CACHE_BLOCK 64       /* Cache block size if sysfs doesn't know it */
+#define CACHE_MAX_BYTES (1<<29) /* Never walk a bigger buffer than this */
+#define TLB_PAGES 8192       /* Pages touched to evict the TLB */
+#define TLB_PAGE 4096        /* Size of those pages */
+#define ROBUST 0             /* 1-> use the robust scheme, not K-best */
+#define WARMUP 2             /* Untimed runs before the robust samples */
+#define NSAMPLES 15          /* Samples taken by the robust scheme */
+#define MAD_CUTOFF 3.0       /* Outliers are this many MADs from median */
+#define CONFIDENCE 0.95      /* Confidence level of the interval */
+#define BOOTSTRAP 1000       /* Bootstrap resamples for the interval */
+
+/* Scales the MAD to estimate the standard deviation of normal data */
+#define MAD_SCALE 1.4826
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
 static double epsilon = EPSILON;
 static int compensate = COMPENSATE;
-static int clear_cache = CLEAR_CACHE;
-static int cache_bytes = CACHE_BYTES;
-static int cache_block = CACHE_BLOCK;
+static int cache_mode = CACHE_MODE;
+static int cache_bytes = 0;  /* 0: twice the LLC size from sysfs */
+static int cache_block = 0;  /* 0: the LLC line size from sysfs */
+static int robust = ROBUST;
+static int warmup = WARMUP;
+static int nsamples = NSAMPLES;
+static double mad_cutoff = MAD_CUTOFF;
+static double confidence = CONFIDENCE;
+static int bootstrap = BOOTSTRAP;
+
+/* The confidence interval and outlier count of the last fcyc call */
+static double last_lo = 0;
+static double last_hi = 0;
+static int last_outliers = 0;
 
 static int *cache_buf = NULL;
+static char *tlb_buf = NULL;
 
 static double *values = NULL;
 static int samplecount = 0;
@@ -94,21 +134,71 @@ static int has_converged() {
         ((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/*
+ * llc_info - Read the size and line size of the last-level cache
+ *     from sysfs. Leaves *size and *line alone if it can't.
+ */
+static void llc_info(int *size, int *line) {
+    char path[128];
+    FILE *fp;
+    int idx, level, best = 0, n, l;
+    char unit;
+
+    for (idx = 0; ; idx++) {
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        if ((fp = fopen(path, "r")) == NULL)
+            break;
+        n = fscanf(fp, "%d", &level);
+        fclose(fp);
+        if (n != 1 || level <= best)
+            continue;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        unit = 0;
+        n = fscanf(fp, "%d%c", &l, &unit);
+        fclose(fp);
+        if (n < 1)
+            continue;
+        best = level;
+        *size = (unit == 'K') ? l << 10 : (unit == 'M') ? l << 20 : l;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/"
+                "coherency_line_size", idx);
+        if ((fp = fopen(path, "r")) != NULL) {
+            if (fscanf(fp, "%d", &l) == 1 && l > 0)
+                *line = l;
+            fclose(fp);
+        }
+    }
+}
+
 /* 
- * clear - Code to clear cache 
+ * clear - Code to clear cache: read one word of each line of a buffer
+ *     twice the size of the LLC
  */
 static volatile int sink = 0;
 
 static void clear() {
     int x = sink;
     int *cptr, *cend;
-    int incr = cache_block/sizeof(int);
+    int incr;
+    int llc = CACHE_BYTES, line = CACHE_BLOCK;
+
+    if (!cache_bytes || !cache_block) {
+        llc_info(&llc, &line);
+        if (!cache_bytes)
+            cache_bytes = (llc > CACHE_MAX_BYTES / 2) ? CACHE_MAX_BYTES : 2 * llc;
+        if (!cache_block)
+            cache_block = line;
+    }
+    incr = cache_block/sizeof(int);
     if (!cache_buf) {
         cache_buf = malloc(cache_bytes);
         if (!cache_buf) {
             fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
             exit(1);
         }
+        memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -120,32 +210,150 @@ static void clear() {
 }
 
 /*
- * fcyc - Use K-best scheme to estimate the running time of function f
+ * clear_tlb - Evict the TLB by touching one word in each of TLB_PAGES
+ *     small pages, more than any TLB holds. The lines touched are
+ *     spread over the cache sets, so only TLB_PAGES lines of cache are
+ *     disturbed.
+ */
+static void clear_tlb() {
+    int x = sink;
+    int i;
+
+    if (!tlb_buf) {
+        tlb_buf = mmap(NULL, (size_t)TLB_PAGES * TLB_PAGE,
+                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (tlb_buf == MAP_FAILED) {
+            fprintf(stderr, "Fatal error.  mmap failed when trying to clear TLB\n");
+            exit(1);
+        }
+#ifdef MADV_NOHUGEPAGE
+        madvise(tlb_buf, (size_t)TLB_PAGES * TLB_PAGE, MADV_NOHUGEPAGE);
+#endif
+        for (i = 0; i < TLB_PAGES; i++)
+            tlb_buf[(size_t)i * TLB_PAGE] = 1;
+    }
+    for (i = 0; i < TLB_PAGES; i++)
+        x += tlb_buf[(size_t)i * TLB_PAGE + (i % (TLB_PAGE / 64)) * 64];
+    sink = x;
+}
+
+/*
+ * fcyc_prepare - Put the caches in the state set_fcyc_cache_mode asked
+ *     for, as before each sample
+ */
+void fcyc_prepare(test_funct f, void *argp) {
+    switch (cache_mode) {
+    case FCYC_CACHE_COLD:
+        clear();
+        break;
+    case FCYC_CACHE_WARM:
+        f(argp);
+        break;
+    case FCYC_CACHE_TLB_COLD:
+        clear_tlb();
+        break;
+    }
+}
+
+/*
+ * measure - Take one sample of the running time of f
+ */
+static double measure(test_funct f, void *argp) {
+    fcyc_prepare(f, argp);
+    if (compensate) {
+        start_comp_counter();
+        f(argp);
+        return get_comp_counter();
+    }
+    start_counter();
+    f(argp);
+    return get_counter();
+}
+
+/*
+ * median - Sort the n values in v and return their median
+ */
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static double median(double *v, int n) {
+    qsort(v, n, sizeof(double), cmp_double);
+    return (n % 2) ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+}
+
+/*
+ * fcyc_robust - Estimate the running time of f as the median of
+ *     nsamples samples with outliers dropped, and set last_lo and
+ *     last_hi to a bootstrap confidence interval for that median:
+ *     the middle confidence fraction of the medians of bootstrap
+ *     resamples (drawn with replacement) of the kept samples.
+ */
+static double fcyc_robust(test_funct f, void *argp) {
+    double *s, *tmp, *meds;
+    double med, mad;
+    int i, j, kept, lo, hi;
+    unsigned int seed = 1;  /* fixed, so intervals are reproducible */
+
+    s = malloc(nsamples * sizeof(double));
+    tmp = malloc(nsamples * sizeof(double));
+    meds = malloc(bootstrap * sizeof(double));
+    if (!s || !tmp || !meds) {
+        fprintf(stderr, "Fatal error.  Malloc returned null in fcyc_robust\n");
+        exit(1);
+    }
+
+    for (i = 0; i < warmup; i++)
+        measure(f, argp);
+    for (i = 0; i < nsamples; i++)
+        s[i] = measure(f, argp);
+
+    /* Drop the samples too far from the median */
+    memcpy(tmp, s, nsamples * sizeof(double));
+    med = median(tmp, nsamples);
+    for (i = 0; i < nsamples; i++)
+        tmp[i] = fabs(s[i] - med);
+    mad = median(tmp, nsamples);
+    for (i = kept = 0; i < nsamples; i++)
+        if (mad == 0 || fabs(s[i] - med) <= mad_cutoff * MAD_SCALE * mad)
+            s[kept++] = s[i];
+    last_outliers = nsamples - kept;
+
+    /* Bootstrap the median of what's left */
+    for (j = 0; j < bootstrap; j++) {
+        for (i = 0; i < kept; i++)
+            tmp[i] = s[rand_r(&seed) % kept];
+        meds[j] = median(tmp, kept);
+    }
+    qsort(meds, bootstrap, sizeof(double), cmp_double);
+    lo = (int)((1 - confidence) / 2 * bootstrap);
+    hi = bootstrap - 1 - lo;
+    last_lo = meds[lo];
+    last_hi = meds[hi];
+    med = median(s, kept);
+
+    free(s);
+    free(tmp);
+    free(meds);
+    return med;
+}
+
+/*
+ * fcyc - Estimate the running time of function f, with the robust
+ *     scheme if it is set and the K-best scheme otherwise
  */
 double fcyc(test_funct f, void *argp) {
     double result;
+
+    if (robust)
+        return fcyc_robust(f, argp);
     init_sampler();
-    if (compensate) {
-        do {
-            double cyc;
-            if (clear_cache)
-                clear();
-            start_comp_counter();
-            f(argp);
-            cyc = get_comp_counter();
-            add_sample(cyc);
-        } while (!has_converged() && samplecount < maxsamples);
-    } else {
-        do {
-            double cyc;
-            if (clear_cache)
-                clear();
-            start_counter();
-            f(argp);
-            cyc = get_counter();
-            add_sample(cyc);
-        } while (!has_converged() && samplecount < maxsamples);
-    }
+    do {
+        add_sample(measure(f, argp));
+    } while (!has_converged() && samplecount < maxsamples);
 #ifdef DEBUG
     {
         int i;
@@ -155,6 +363,8 @@ double fcyc(test_funct f, void *argp) {
     }
 #endif
     result = values[0];
+    last_lo = last_hi = result;
+    last_outliers = 0;
 #if !KEEP_VALS
     free(values);
     values = NULL;
@@ -169,16 +379,25 @@ double fcyc(test_funct f, void *argp) {
 
 /* 
  * set_fcyc_clear_cache - When set, will run code to clear cache 
- *     before each measurement. 
+ *     before each measurement (same as FCYC_CACHE_COLD).
  *     Default = 0
  */
 void set_fcyc_clear_cache(int clear) {
-    clear_cache = clear;
+    cache_mode = clear ? FCYC_CACHE_COLD : FCYC_CACHE_ASIS;
+}
+
+/*
+ * set_fcyc_cache_mode - Cache state to put the machine in before
+ *     each measurement (one of FCYC_CACHE_*)
+ *     Default = FCYC_CACHE_ASIS
+ */
+void set_fcyc_cache_mode(int mode) {
+    cache_mode = mode;
 }
 
 /* 
- * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ * set_fcyc_cache_size - Set size of buffer to walk when clearing cache 
+ *     Default = twice the LLC size in sysfs, else 1<<20
  */
 void set_fcyc_cache_size(int bytes) {
     if (bytes != cache_bytes) {
@@ -192,7 +411,7 @@ void set_fcyc_cache_size(int bytes) {
 
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = the LLC line size in sysfs, else 64
  */
 void set_fcyc_cache_block(int bytes) {
     cache_block = bytes;
@@ -234,3 +453,62 @@ void set_fcyc_epsilon(double epsilon_arg) {
     epsilon = epsilon_arg;
 }
 
+/*
+ * set_fcyc_robust - When set, use the robust scheme instead of K-best
+ *     Default = 0
+ */
+void set_fcyc_robust(int robust_arg) {
+    robust = robust_arg;
+}
+
+/*
+ * set_fcyc_warmup - Untimed runs before the robust scheme's samples
+ *     Default = 2
+ */
+void set_fcyc_warmup(int warmup_arg) {
+    warmup = warmup_arg;
+}
+
+/*
+ * set_fcyc_samples - Number of samples the robust scheme takes
+ *     Default = 15
+ */
+void set_fcyc_samples(int samples_arg) {
+    nsamples = (samples_arg > 0) ? samples_arg : 1;
+}
+
+/*
+ * set_fcyc_mad_cutoff - Drop samples more than this many scaled MADs
+ *     from the median
+ *     Default = 3.0
+ */
+void set_fcyc_mad_cutoff(double cutoff_arg) {
+    mad_cutoff = cutoff_arg;
+}
+
+/*
+ * set_fcyc_confidence - Confidence level of the bootstrap interval
+ *     Default = 0.95
+ */
+void set_fcyc_confidence(double confidence_arg) {
+    confidence = confidence_arg;
+}
+
+/*
+ * set_fcyc_bootstrap - Number of bootstrap resamples
+ *     Default = 1000
+ */
+void set_fcyc_bootstrap(int bootstrap_arg) {
+    bootstrap = (bootstrap_arg > 0) ? bootstrap_arg : 1;
+}
+
+/*
+ * fcyc_interval - Set *lo and *hi to the confidence interval of the
+ *     last fcyc call, and return the number of outliers it dropped.
+ *     (Under K-best, the interval is just the result.)
+ */
+int fcyc_interval(double *lo, double *hi) {
+    *lo = last_lo;
+    *hi = last_hi;
+    return last_outliers;
+}
@@ -7,32 +7,48 @@
  *
  */
 
+/* Cache states fcyc can set up before each sample */
+#define FCYC_CACHE_ASIS     0  /* leave the caches as the last run left them */
+#define FCYC_CACHE_COLD     1  /* evict everything from the caches */
+#define FCYC_CACHE_WARM     2  /* run the test function once, untimed */
+#define FCYC_CACHE_TLB_COLD 3  /* evict the TLB, but few cache lines */
+
 /* The test function takes a generic pointer as input */
 typedef void (*test_funct)(void *);
 
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Set up the cache state for one run of f, as fcyc does for each sample */
+void fcyc_prepare(test_funct f, void *argp);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
 
 /* 
  * set_fcyc_clear_cache - When set, will run code to clear cache 
- *     before each measurement. 
+ *     before each measurement (same as FCYC_CACHE_COLD).
  *     Default = 0
  */
 void set_fcyc_clear_cache(int clear);
 
+/*
+ * set_fcyc_cache_mode - Cache state to put the machine in before
+ *     each measurement (one of FCYC_CACHE_*)
+ *     Default = FCYC_CACHE_ASIS
+ */
+void set_fcyc_cache_mode(int mode);
+
 /* 
- * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ * set_fcyc_cache_size - Set size of buffer to walk when clearing cache 
+ *     Default = twice the LLC size in sysfs, else 1<<20
  */
 void set_fcyc_cache_size(int bytes);
 
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = the LLC line size in sysfs, else 64
  */
 void set_fcyc_cache_block(int bytes);
 
@@ -63,6 +79,45 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/*
+ * set_fcyc_robust - When set, use the robust scheme instead of K-best:
+ *     warmup runs, a fixed number of samples, MAD outlier rejection,
+ *     and the median with a bootstrap confidence interval
+ *     Default = 0
+ */
+void set_fcyc_robust(int robust_arg);
 
+/*
+ * set_fcyc_warmup - Untimed runs before the robust scheme's samples
+ *     Default = 2
+ */
+void set_fcyc_warmup(int warmup_arg);
 
+/*
+ * set_fcyc_samples - Number of samples the robust scheme takes
+ *     Default = 15
+ */
+void set_fcyc_samples(int samples_arg);
+
+/*
+ * set_fcyc_mad_cutoff - Drop samples more than this many scaled MADs
+ *     from the median
+ *     Default = 3.0
+ */
+void set_fcyc_mad_cutoff(double cutoff_arg);
+
+/*
+ * set_fcyc_confidence - Confidence level of the bootstrap interval
+ *     Default = 0.95
+ */
+void set_fcyc_confidence(double confidence_arg);
+
+/*
+ * set_fcyc_bootstrap - Number of bootstrap resamples
+ *     Default = 1000
+ */
+void set_fcyc_bootstrap(int bootstrap_arg);
 
+/* Get the confidence interval (in cycles) of the last fcyc call;
+   returns the number of samples dropped as outliers */
+int fcyc_interval(double *lo, double *hi);
@@ -2,6 +2,7 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <string.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -12,43 +13,252 @@ static double Mhz;  /* estimated CPU clock frequency */
 
 extern int verbose; /* -v option in mdriver.c */
 
+/* The timer picked in config.h, unless set_fsecs_timer overrides it */
+#if USE_FCYC
+static fsecs_timer_t timer = FSECS_FCYC;
+#elif USE_ITIMER
+static fsecs_timer_t timer = FSECS_ITIMER;
+#elif USE_GETTOD
+static fsecs_timer_t timer = FSECS_GETTOD;
+#elif USE_MONOTONIC
+static fsecs_timer_t timer = FSECS_MONOTONIC;
+#else
+static fsecs_timer_t timer = FSECS_TSC;
+#endif
+
+/* Hardware counts from the last fsecs call (see set_fsecs_counters) */
+static int count_events = 0;
+static perfctr_counts_t last_counts;
+
+/* Samples for fcyc's robust scheme; 0 to use its K-best scheme */
+static int robust_samples = 0;
+
+/* Confidence interval of the last fsecs call, if it has one */
+static int has_interval = 0;
+static double last_lo, last_hi;
+
+/* Cache state fcyc sets up before each sample (FCYC_CACHE_*) */
+static int cache_mode = FCYC_CACHE_COLD;
+
+static const char *cache_names[] = {
+    "asis", "cold", "warm", "tlb-cold"
+};
+
+static const char *timer_names[] = {
+    "fcyc", "itimer", "gettod", "monotonic", "tsc"
+};
+
+/*
+ * set_fsecs_timer - Choose the timer; call before init_fsecs
+ */
+void set_fsecs_timer(fsecs_timer_t t) {
+    timer = t;
+}
+
+/*
+ * fsecs_parse_timer - Look up a timer by name; return -1 if unknown
+ */
+int fsecs_parse_timer(const char *name, fsecs_timer_t *t) {
+    int i;
+
+    for (i = 0; i < sizeof(timer_names) / sizeof(timer_names[0]); i++) {
+        if (strcmp(name, timer_names[i]) == 0) {
+            *t = (fsecs_timer_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * fsecs_timer_name - Return the name of a timer
+ */
+const char *fsecs_timer_name(fsecs_timer_t t) {
+    return timer_names[t];
+}
+
+/*
+ * fsecs_timer - Return the timer in use. After init_fsecs, this is
+ * FSECS_MONOTONIC if the TSC was asked for but can't be used.
+ */
+fsecs_timer_t fsecs_timer(void) {
+    return timer;
+}
+
+/*
+ * set_fsecs_counters - If on, have each fsecs call make one extra,
+ *     untimed run of f under the hardware performance counters
+ */
+void set_fsecs_counters(int on) {
+    count_events = on;
+}
+
+/*
+ * fsecs_counters - Copy out the counts from the last fsecs call.
+ *     Returns 0 if counting is off, else 1 (some counts may still be -1)
+ */
+int fsecs_counters(perfctr_counts_t *counts) {
+    if (!count_events)
+        return 0;
+    *counts = last_counts;
+    return 1;
+}
+
+/*
+ * set_fsecs_cache - Choose the cache state the fcyc timer sets up
+ *     before each sample (one of FCYC_CACHE_*)
+ */
+void set_fsecs_cache(int mode) {
+    cache_mode = mode;
+}
+
+/*
+ * fsecs_cache - Return the cache state the fcyc timer sets up
+ */
+int fsecs_cache(void) {
+    return cache_mode;
+}
+
+/*
+ * fsecs_parse_cache - Look up a cache state by name; -1 if unknown
+ */
+int fsecs_parse_cache(const char *name, int *mode) {
+    int i;
+
+    for (i = 0; i < sizeof(cache_names) / sizeof(cache_names[0]); i++) {
+        if (strcmp(name, cache_names[i]) == 0) {
+            *mode = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * fsecs_cache_name - Return the name of a cache state
+ */
+const char *fsecs_cache_name(int mode) {
+    return cache_names[mode];
+}
+
+/*
+ * set_fsecs_robust - Time with fcyc's robust scheme, taking this many
+ *     samples (0: use K-best). Only the fcyc timer has it.
+ */
+void set_fsecs_robust(int samples) {
+    robust_samples = samples;
+}
+
+/*
+ * fsecs_interval - Set *lo and *hi to the confidence interval (in
+ *     seconds) of the last fsecs call. Returns 0 if it doesn't have one.
+ */
+int fsecs_interval(double *lo, double *hi) {
+    *lo = last_lo;
+    *hi = last_hi;
+    return has_interval;
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
 void init_fsecs(void) {
     Mhz = 0; /* keep gcc -Wall happy */
 
-#if USE_FCYC
-    if (verbose)
-        printf("Measuring performance with a cycle counter.\n");
-
-    /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20);
-    set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
-#elif USE_ITIMER
-    if (verbose)
-        printf("Measuring performance with the interval timer.\n");
-#elif USE_GETTOD
-    if (verbose)
-        printf("Measuring performance with gettimeofday().\n");
-#endif
+    switch (timer) {
+    case FSECS_FCYC:
+        if (verbose)
+            printf("Measuring performance with a cycle counter "
+                   "(%s cache).\n", cache_names[cache_mode]);
+
+        /* set key parameters for the fcyc package */
+        set_fcyc_maxsamples(20);
+        set_fcyc_cache_mode(cache_mode);
+        set_fcyc_compensate(1);
+        set_fcyc_epsilon(0.01);
+        set_fcyc_k(3);
+        if (robust_samples > 0) {
+            set_fcyc_robust(1);
+            set_fcyc_samples(robust_samples);
+            if (verbose)
+                printf("Taking the median of %d samples, "
+                       "with a 95%% confidence interval.\n", robust_samples);
+        }
+
+        /* On x86 the cycle counter is the TSC, which we may know already */
+        Mhz = ftimer_tsc_hz() / 1e6;
+        if (Mhz == 0)
+            Mhz = mhz(verbose > 0);
+        break;
+    case FSECS_ITIMER:
+        if (verbose)
+            printf("Measuring performance with the interval timer.\n");
+        break;
+    case FSECS_GETTOD:
+        if (verbose)
+            printf("Measuring performance with gettimeofday().\n");
+        break;
+    case FSECS_TSC:
+        if (ftimer_tsc_hz() > 0) {
+            if (verbose)
+                printf("Measuring performance with the invariant TSC "
+                       "(%.1f MHz).\n", ftimer_tsc_hz() / 1e6);
+            break;
+        }
+        if (verbose)
+            printf("No invariant TSC, falling back to the monotonic clock.\n");
+        timer = FSECS_MONOTONIC;
+        /* fall through */
+    case FSECS_MONOTONIC:
+        if (verbose)
+            printf("Measuring performance with CLOCK_MONOTONIC_RAW.\n");
+        break;
+    }
 }
 
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double fsecs(fsecs_test_funct f, void *argp) {
-#if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif
-}
+    double secs = 0;
 
+    has_interval = 0;
+    switch (timer) {
+    case FSECS_FCYC:
+        secs = fcyc(f, argp) / (Mhz*1e6);
+        if (robust_samples > 0) {
+            fcyc_interval(&last_lo, &last_hi);
+            last_lo /= Mhz*1e6;
+            last_hi /= Mhz*1e6;
+            has_interval = 1;
+        }
+        break;
+    case FSECS_ITIMER:
+        secs = ftimer_itimer(f, argp, 10);
+        break;
+    case FSECS_GETTOD:
+        secs = ftimer_gettod(f, argp, 10);
+        break;
+    case FSECS_MONOTONIC:
+        secs = ftimer_monotonic(f, argp, 10);
+        break;
+    case FSECS_TSC:
+        secs = ftimer_tsc(f, argp, 10);
+        break;
+    }
+
+    /*
+     * Count in a separate run, so that opening and reading the
+     * counters stays out of the timings.  Set the caches up for it
+     * as the cycle counter does for each sample, so that the counts
+     * match what was timed, not a run warmed by the ones before.
+     */
+    if (count_events) {
+        if (timer == FSECS_FCYC)
+            fcyc_prepare(f, argp);
+        perfctr_start();
+        f(argp);
+        perfctr_stop(&last_counts);
+    }
+    return secs;
+}
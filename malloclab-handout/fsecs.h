@@ -1,4 +1,31 @@
+#include "perfctr.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
+/* The ways fsecs can time a function */
+typedef enum {
+    FSECS_FCYC,      /* cycle counter w/K-best scheme */
+    FSECS_ITIMER,    /* interval timer */
+    FSECS_GETTOD,    /* gettimeofday */
+    FSECS_MONOTONIC, /* clock_gettime(CLOCK_MONOTONIC_RAW) */
+    FSECS_TSC        /* invariant TSC, calibrated against the above */
+} fsecs_timer_t;
+
+void set_fsecs_timer(fsecs_timer_t timer);
+int fsecs_parse_timer(const char *name, fsecs_timer_t *timer);
+const char *fsecs_timer_name(fsecs_timer_t timer);
+fsecs_timer_t fsecs_timer(void);
+
+void set_fsecs_cache(int mode);
+int fsecs_cache(void);
+int fsecs_parse_cache(const char *name, int *mode);
+const char *fsecs_cache_name(int mode);
+
+void set_fsecs_robust(int samples);
+int fsecs_interval(double *lo, double *hi);
+
+void set_fsecs_counters(int on);
+int fsecs_counters(perfctr_counts_t *counts);
+
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
@@ -7,9 +7,18 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_monotonic: version that uses clock_gettime(CLOCK_MONOTONIC_RAW)
+ *    ftimer_tsc: version that uses the invariant time stamp counter
+ *
+ * Also provides a nanosecond clock for timing individual operations.
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #include "ftimer.h"
 
 /* function prototypes */
@@ -50,6 +59,179 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n) {
     return (1E-3*diff);
 }
 
+/*
+ * raw_ns - Read the raw monotonic clock (not slewed by NTP), in ns
+ */
+static long long raw_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Short functions get more than n runs, until they have been timed
+ * for at least MIN_TOTAL_NS in all (but never more than MAX_RUNS)
+ */
+#define MIN_TOTAL_NS 200000000LL
+#define MAX_RUNS 1000
+
+/*
+ * ftimer_monotonic - Use CLOCK_MONOTONIC_RAW to estimate the running
+ * time of f(argp). Each run is timed on its own, and the fastest is
+ * returned: anything that makes a run slower (an interrupt, a
+ * migration, another process) is noise, while nothing makes it faster.
+ */
+double ftimer_monotonic(ftimer_test_funct f, void *argp, int n) {
+    long long t0, t, best = -1, total = 0;
+    int i;
+
+    for (i = 0; i < n || (total < MIN_TOTAL_NS && i < MAX_RUNS); i++) {
+        t0 = raw_ns();
+        f(argp);
+        t = raw_ns() - t0;
+        total += t;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best * 1e-9;
+}
+
+/*
+ * Routines for the time stamp counter
+ */
+
+/* How long to count TSC ticks against the raw clock when calibrating */
+#define TSC_CALIBRATE_NS 50000000LL
+
+static double tsc_hz = 0;  /* calibrated TSC frequency; -1 if unusable */
+
+#if defined(__i386__) || defined(__x86_64__)
+/*
+ * tsc_begin/tsc_end - Read the TSC at the start and end of a timed
+ * region. The lfence before rdtsc keeps earlier instructions from
+ * leaking into the region; rdtscp waits for the region to finish, and
+ * the lfence after it keeps later instructions from starting early.
+ */
+static inline unsigned long long tsc_begin(void) {
+    _mm_lfence();
+    return __rdtsc();
+}
+
+static inline unsigned long long tsc_end(void) {
+    unsigned int aux;
+    unsigned long long t = __rdtscp(&aux);
+
+    _mm_lfence();
+    return t;
+}
+
+/*
+ * tsc_invariant - Does the TSC tick at a constant rate through P- and
+ * C-state changes, and does this CPU have rdtscp?
+ */
+static int tsc_invariant(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return 0;
+    __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 27)))     /* RDTSCP */
+        return 0;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1 << 8)) != 0;   /* invariant TSC */
+}
+#endif
+
+/*
+ * ftimer_tsc_hz - Return the TSC frequency in Hz, calibrated against
+ * CLOCK_MONOTONIC_RAW the first time we are called, or 0 if there is
+ * no invariant TSC to use. The calibration busy-waits rather than
+ * sleeping, so the CPU stays in the same state it is timed in.
+ */
+double ftimer_tsc_hz(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned long long c0, c1;
+    long long t0, t1;
+
+    if (tsc_hz != 0)
+        return (tsc_hz > 0) ? tsc_hz : 0;
+    if (!tsc_invariant()) {
+        tsc_hz = -1;
+        return 0;
+    }
+    t0 = raw_ns();
+    c0 = tsc_begin();
+    do {
+        t1 = raw_ns();
+    } while (t1 - t0 < TSC_CALIBRATE_NS);
+    c1 = tsc_end();
+    t1 = raw_ns();
+    tsc_hz = (double)(c1 - c0) * 1e9 / (t1 - t0);
+    return tsc_hz;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * ftimer_tsc - Use the invariant TSC to estimate the running time of
+ * f(argp). Like ftimer_monotonic, returns the fastest of at least n
+ * runs. Falls back to ftimer_monotonic if there is no usable TSC.
+ */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int n) {
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned long long c0, c, best = 0, total = 0, min_total;
+    double hz = ftimer_tsc_hz();
+    int i;
+
+    if (hz == 0)
+        return ftimer_monotonic(f, argp, n);
+    min_total = (unsigned long long)(hz * MIN_TOTAL_NS * 1e-9);
+    for (i = 0; i < n || (total < min_total && i < MAX_RUNS); i++) {
+        c0 = tsc_begin();
+        f(argp);
+        c = tsc_end() - c0;
+        total += c;
+        if (i == 0 || c < best)
+            best = c;
+    }
+    return best / hz;
+#else
+    return ftimer_monotonic(f, argp, n);
+#endif
+}
+
+/*
+ * ftimer_now_ns - Read the monotonic clock, in nanoseconds
+ */
+long long ftimer_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * ftimer_now_overhead - Estimate the cost of a call to ftimer_now_ns by
+ * timing many back-to-back pairs of calls and taking the smallest gap.
+ * (The smallest rather than the average, so that subtracting it never
+ * makes a real measurement come out negative.)
+ */
+#define OVERHEAD_SAMPLES 10000
+
+long long ftimer_now_overhead(void) {
+    long long t0, t1, best = -1;
+    int i;
+
+    for (i = 0; i < OVERHEAD_SAMPLES; i++) {
+        t0 = ftimer_now_ns();
+        t1 = ftimer_now_ns();
+        if (best < 0 || t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
 
 /*
  * Routines for manipulating the Unix interval timer
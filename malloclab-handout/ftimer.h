@@ -12,3 +12,25 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+
+/* Estimate the running time of f(argp) using CLOCK_MONOTONIC_RAW.
+   Return the fastest of at least n runs (more for short functions) */
+double ftimer_monotonic(ftimer_test_funct f, void *argp, int n);
+
+
+/* Estimate the running time of f(argp) using the invariant TSC
+   (rdtscp), falling back to ftimer_monotonic without one.
+   Return the fastest of at least n runs (more for short functions) */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int n);
+
+/* TSC frequency in Hz, calibrated against the monotonic clock on the
+   first call; 0 if there is no invariant TSC */
+double ftimer_tsc_hz(void);
+
+
+/* Read the monotonic clock, in nanoseconds */
+long long ftimer_now_ns(void);
+
+/* Estimate the cost (in nanoseconds) of reading the clock with
+   ftimer_now_ns, so it can be subtracted from short measurements */
+long long ftimer_now_overhead(void);
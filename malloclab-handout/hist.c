@@ -0,0 +1,86 @@
+/*
+ * hist.c - Log-bucketed histograms for recording latencies
+ *
+ * A value v below HIST_SUB_BUCKETS goes into bucket v. Otherwise, if
+ * the highest set bit of v is bit e, the HIST_SUB_BITS bits just below
+ * it select one of HIST_SUB_BUCKETS sub-buckets for the range
+ * [2^e, 2^(e+1)). Recording a value is just a count-leading-zeros and
+ * a couple of shifts, so it is cheap enough for a per-operation timer.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/* Return the bucket that value falls into */
+static int bucket_of(unsigned long value) {
+    int e, sub;
+
+    if (value < HIST_SUB_BUCKETS)
+        return (int)value;
+    e = 63 - __builtin_clzl(value);
+    if (e >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+    sub = (int)(value >> (e - HIST_SUB_BITS)) - HIST_SUB_BUCKETS;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+/* Return the largest value that falls into bucket b */
+static unsigned long bucket_high(int b) {
+    int shift;
+    unsigned long sub;
+
+    if (b < HIST_SUB_BUCKETS)
+        return (unsigned long)b;
+    shift = b / HIST_SUB_BUCKETS - 1;
+    sub = (unsigned long)(b % HIST_SUB_BUCKETS);
+    return ((HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/*
+ * hist_init - Empty the histogram
+ */
+void hist_init(hist_t *h) {
+    memset(h, 0, sizeof(hist_t));
+}
+
+/*
+ * hist_record - Record one value
+ */
+void hist_record(hist_t *h, unsigned long value) {
+    h->counts[bucket_of(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+/*
+ * hist_percentile - Return the value below which pct percent of the
+ *     recorded values fall. The answer is the upper end of the bucket
+ *     holding that rank, capped at the largest value actually seen.
+ */
+unsigned long hist_percentile(hist_t *h, double pct) {
+    unsigned long rank, seen = 0;
+    unsigned long high;
+    int b;
+
+    if (h->total == 0)
+        return 0;
+    rank = (unsigned long)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank)
+            break;
+    }
+    high = bucket_high(b);
+    return (high < h->max) ? high : h->max;
+}
+
+/*
+ * hist_mean - Return the mean of the recorded values
+ */
+double hist_mean(hist_t *h) {
+    return (h->total > 0) ? h->sum / h->total : 0.0;
+}
@@ -0,0 +1,36 @@
+/*
+ * hist.h - Log-bucketed histograms for recording latencies
+ *
+ * Values are bucketed HDR-style: each power of two is split into
+ * HIST_SUB_BUCKETS linear sub-buckets, so every recorded value is
+ * kept to within 1/HIST_SUB_BUCKETS of its true value, from a few
+ * nanoseconds up to 2^HIST_MAX_BITS.
+ */
+#ifndef __HIST_H
+#define __HIST_H
+
+#define HIST_SUB_BITS    5                    /* 32 sub-buckets per power of 2 */
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS    40                   /* larger values are clamped */
+#define HIST_BUCKETS     ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct {
+    unsigned long counts[HIST_BUCKETS]; /* number of values in each bucket */
+    unsigned long total;                /* number of values recorded */
+    unsigned long max;                  /* largest value recorded */
+    double sum;                         /* sum of all values recorded */
+} hist_t;
+
+/* Empty the histogram */
+void hist_init(hist_t *h);
+
+/* Record one value */
+void hist_record(hist_t *h, unsigned long value);
+
+/* Return the value below which pct percent of the recorded values fall */
+unsigned long hist_percentile(hist_t *h, double pct);
+
+/* Return the mean of the recorded values */
+double hist_mean(hist_t *h);
+
+#endif /* __HIST_H */
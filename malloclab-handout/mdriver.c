@@ -1,24 +1,38 @@
 /*
  * mdriver.c - CS:APP Malloc Lab Driver
  *
- * Uses a collection of trace files to tests a malloc/free
- * implementation in mm.c.
+ * Uses a collection of trace files to tests a malloc/free/realloc/
+ * calloc/memalign implementation in mm.c.
  *
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE    /* for sched_setaffinity() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
+#include "hist.h"
+#include "compare.h"
+#include "perfctr.h"
+#include "benchenv.h"
+#include "allocator.h"
 #include "config.h"
 
 /**********************
@@ -29,6 +43,7 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAX_ALLOCS     8 /* max allocators compared with --alloc */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
@@ -46,19 +61,21 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc request */
+    int size;                         /* byte size of alloc/realloc request */
+    int arg;                          /* calloc nmemb or memalign alignment */
 } traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
+    char *filename;      /* name of the trace file */
     int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc ids */
+    int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc... */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
 
@@ -70,21 +87,64 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    allocator_t *alloc;  /* for eval_alloc_speed */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
-    double ops;      /* number of ops (malloc/free) in the trace */
+    double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
 
-    /* defined only for the student malloc package */
-    double util;     /* space utilization for this trace (always 0 for libc) */
+    /* for mm.c, peak payload over heap size; for an allocator_t
+       (mm.c included), peak payload over peak usable size */
+    double util;     /* space utilization for this trace */
+
+    /* resident memory after the util pass (--pages); 0 if not measured */
+    size_t pages;    /* pages of the heap the allocator touched */
+    size_t rss;      /* resident set size of the process in bytes */
+
+    /* blocks mm.c looked at per free-block search in the util pass
+       (--search); 0 if not measured */
+    double search;
+
+    /* confidence interval of secs, from fcyc's robust sampler (--samples) */
+    int has_ci;
+    double secs_lo, secs_hi;
+
+    /* hardware counts from one untimed run (--counters) */
+    int counted;     /* set if counters were requested for this trace */
+    perfctr_counts_t counters;  /* -1 for events that weren't counted */
+
+    /* secs for each timed run (--runs); secs above is their median */
+    int nsamples;
+    double samples[COMPARE_MAXRUNS];
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* Per-operation latency histograms for one trace (-L) */
+enum {LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_CALLOC, LAT_MEMALIGN,
+      LAT_NUMOPS};
+
+typedef struct {
+    hist_t hists[LAT_NUMOPS]; /* latencies in ns, one histogram per op type */
+} latency_t;
+
+/* What a -j worker sends back to the parent through its pipe */
+typedef struct {
+    int errors;      /* number of errors the worker found */
+    stats_t stats;   /* stats for the worker's trace */
+} result_t;
+
+/* Bookkeeping for one running -j worker */
+typedef struct {
+    pid_t pid;       /* worker process id (0 if the slot is idle) */
+    int fd;          /* read end of the worker's result pipe */
+    int tracenum;    /* trace the worker is evaluating */
+} worker_t;
+
 /********************
  * Global variables
  *******************/
@@ -100,6 +160,85 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* Number of traces to evaluate concurrently in forked workers (-j) */
+static int num_jobs = 1;
+
+/* CPUs that timed workers are pinned to, one worker per CPU (-P) */
+static int *pin_cpus = NULL;
+static int num_pin_cpus = 0;
+
+/* Per-op latency histograms for each trace, or NULL unless -L */
+static latency_t *latencies = NULL;
+static char *latency_file = NULL;    /* CSV export of the latencies (-O) */
+static long long clock_overhead = 0; /* ns to subtract from each latency */
+static char *latency_opnames[LAT_NUMOPS] = {
+    "malloc", "free", "realloc", "calloc", "memalign"
+};
+
+/* Machine-readable results and regression checking */
+static char *json_file = NULL;      /* write results as JSON here (-J) */
+static char *baseline_file = NULL;  /* compare against this JSON file */
+static int num_runs = 0;            /* timed runs per trace (0: default) */
+static double threshold = 5.0;      /* flag throughput changes beyond this % */
+static double util_threshold = 1.0; /* flag util drops beyond this many points */
+static double alpha = 0.05;         /* significance level for --compare */
+
+/* Fragmentation-over-time profile of the util pass (--frag) */
+static int frag_interval = 0;            /* sample every this many ops */
+static char *frag_file = "frag.csv";     /* write the samples here */
+static FILE *frag_fp = NULL;
+
+/* Storage behind the simulated heap (see mem_configure in memlib.c) */
+static mem_backend_t heap_backend = MEM_BACKEND_MALLOC;
+static size_t max_heap = MAX_HEAP;
+static int page_stats = 0;          /* report touched pages and RSS */
+static int debug_heap = 0;          /* guard pages, poison, shadow map (-D) */
+static int search_stats = 0;        /* report mm.c's average search length */
+static mm_free_list_t free_list = MM_FREE_LIST_ADDRESS; /* mm.c's policy */
+static int predict = 0;             /* mm.c guesses lifetimes (--predict) */
+
+/* Report IPC and misses per op from the hardware counters (--counters) */
+static int hw_counters = 0;
+
+/* Samples per run for fcyc's robust sampler (--samples); 0 if unused */
+static int robust_samples = 0;
+
+/* Where and how we run (--cpu, --fifo), recorded with the results */
+static benchenv_t env;
+
+/* Long-only command line options */
+enum {OPT_COMPARE = 256, OPT_RUNS, OPT_THRESHOLD, OPT_UTIL_THRESHOLD, OPT_ALPHA,
+      OPT_FRAG, OPT_FRAG_FILE, OPT_HEAP_BACKEND, OPT_MAX_HEAP, OPT_PAGES,
+      OPT_TIMER, OPT_COUNTERS, OPT_SAMPLES, OPT_CACHE,
+      OPT_CPU, OPT_FIFO, OPT_ALLOC, OPT_SEARCH, OPT_FREE_LIST,
+      OPT_PREDICT};
+
+static struct option long_options[] = {
+    {"json",           required_argument, NULL, 'J'},
+    {"compare",        required_argument, NULL, OPT_COMPARE},
+    {"runs",           required_argument, NULL, OPT_RUNS},
+    {"threshold",      required_argument, NULL, OPT_THRESHOLD},
+    {"util-threshold", required_argument, NULL, OPT_UTIL_THRESHOLD},
+    {"alpha",          required_argument, NULL, OPT_ALPHA},
+    {"frag",           required_argument, NULL, OPT_FRAG},
+    {"frag-file",      required_argument, NULL, OPT_FRAG_FILE},
+    {"heap-backend",   required_argument, NULL, OPT_HEAP_BACKEND},
+    {"max-heap",       required_argument, NULL, OPT_MAX_HEAP},
+    {"pages",          no_argument,       NULL, OPT_PAGES},
+    {"debug-heap",     no_argument,       NULL, 'D'},
+    {"timer",          required_argument, NULL, OPT_TIMER},
+    {"counters",       no_argument,       NULL, OPT_COUNTERS},
+    {"samples",        required_argument, NULL, OPT_SAMPLES},
+    {"cache",          required_argument, NULL, OPT_CACHE},
+    {"cpu",            required_argument, NULL, OPT_CPU},
+    {"fifo",           no_argument,       NULL, OPT_FIFO},
+    {"alloc",          required_argument, NULL, OPT_ALLOC},
+    {"search",         no_argument,       NULL, OPT_SEARCH},
+    {"free-list",      required_argument, NULL, OPT_FREE_LIST},
+    {"predict",        no_argument,       NULL, OPT_PREDICT},
+    {NULL, 0, NULL, 0}
+};
+
 
 /*********************
  * Function prototypes
@@ -110,53 +249,103 @@ static int add_range(range_t **ranges, char *lo, int size,
                      int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static int check_payload(trace_t *trace, int index, int tracenum,
+                         int opnum);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
 
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
-static void eval_libc_speed(void *ptr);
+/* Routines for evaluating the correctness, utilization, and speed of
+   any malloc package behind an allocator_t (libc's, or --alloc ones) */
+static int eval_alloc_valid(allocator_t *alloc, trace_t *trace, int tracenum,
+                            stats_t *stats);
+static void eval_alloc_speed(void *ptr);
+static char *alloc_op(allocator_t *alloc, traceop_t *op);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static char *mm_alloc_op(traceop_t *op);
+static int latency_op(traceop_t *op);
+static void sample_frag(trace_t *trace, int tracenum, int opnum,
+                        long live_bytes);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
+
+/* Routines that evaluate a single trace, either in place or in a worker */
+static void eval_alloc_trace(allocator_t *alloc, char *filename,
+                             int tracenum, int timed, stats_t *stats);
+static void run_alloc_trace(allocator_t *alloc, char *filename, int tracenum,
+                            stats_t *stats);
+static void eval_mm_trace(char *filename, int tracenum, int timed,
+                          stats_t *stats, latency_t *lat);
+static void run_workers(char **tracefiles, int n, allocator_t *alloc,
+                        stats_t *stats);
+static void time_trace(fsecs_test_funct f, speed_t *params, stats_t *stats);
+static void start_worker(worker_t *w, int slot, char *filename,
+                         int tracenum, allocator_t *alloc, int timed);
+static void pin_to_cpu(int cpu);
+static int parse_cpulist(char *list, int **cpus);
+static size_t parse_size(char *s);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatencies(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printallocators(int n, int nalloc, allocator_t **allocs,
+                            stats_t **stats);
+static void write_latency_csv(char *filename, char **tracefiles, int n,
+                              stats_t *stats);
+static void write_json(char *filename, char **tracefiles, int n,
+                       stats_t *mm_stats, stats_t *libc_stats,
+                       int nalloc, allocator_t **allocs, stats_t **alloc_stats,
+                       double p1, double p2, double perfindex);
+static int compare_results(char *filename, char **tracefiles, int n,
+                           stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
+static void debug_heap_segv(int sig, siginfo_t *info, void *context);
 
 /**************
  * Main routine
  **************/
 int main(int argc, char **argv) {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
+    allocator_t *libc_alloc = NULL;
+
+    /* allocators to compare side by side (--alloc) */
+    char *alloc_specs[MAX_ALLOCS];
+    int num_allocs = 0;
+    allocator_t *allocs[MAX_ALLOCS];
+    stats_t *alloc_stats[MAX_ALLOCS];
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
     int numcorrect;
+    fsecs_timer_t timer;
+    int timer_given = 0; /* set if --timer named a timer */
+    int cache;
+    int cache_given = 0; /* set if --cache asked for a cache state */
+    int cpu = -1;        /* pin to this CPU (--cpu) */
+    int fifo = 0;        /* run under SCHED_FIFO (--fifo) */
 
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgl")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:hvVglj:P:LO:J:D",
+                            long_options, NULL)) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
@@ -179,6 +368,139 @@ int main(int argc, char **argv) {
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'j': /* Evaluate up to this many traces concurrently */
+            num_jobs = atoi(optarg);
+            if (num_jobs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Pin timed workers to this list of CPUs */
+            num_pin_cpus = parse_cpulist(optarg, &pin_cpus);
+            if (num_pin_cpus == 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'L': /* Report per-operation latency percentiles */
+            latency_file = (latency_file) ? latency_file : "";
+            break;
+        case 'O': /* Also export the latencies as CSV (implies -L) */
+            latency_file = strdup(optarg);
+            break;
+        case 'J': /* Write the results as JSON ("-" for stdout) */
+            json_file = strdup(optarg);
+            break;
+        case OPT_COMPARE: /* Check for regressions against a JSON baseline */
+            baseline_file = strdup(optarg);
+            break;
+        case OPT_RUNS: /* Number of timed runs per trace */
+            num_runs = atoi(optarg);
+            if (num_runs < 1 || num_runs > COMPARE_MAXRUNS) {
+                fprintf(stderr, "--runs must be between 1 and %d\n",
+                        COMPARE_MAXRUNS);
+                exit(1);
+            }
+            break;
+        case OPT_THRESHOLD: /* Throughput change (%) considered a regression */
+            threshold = atof(optarg);
+            break;
+        case OPT_UTIL_THRESHOLD: /* Util drop (points) considered a regression */
+            util_threshold = atof(optarg);
+            break;
+        case OPT_ALPHA: /* Significance level of the comparison */
+            alpha = atof(optarg);
+            break;
+        case OPT_FRAG: /* Profile fragmentation every n ops */
+            frag_interval = atoi(optarg);
+            if (frag_interval < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case OPT_FRAG_FILE: /* Where to write the fragmentation profile */
+            frag_file = strdup(optarg);
+            break;
+        case OPT_HEAP_BACKEND: /* Where memlib gets the simulated heap */
+            if (mem_parse_backend(optarg, &heap_backend) < 0) {
+                fprintf(stderr, "Unknown heap backend: %s\n", optarg);
+                usage();
+                exit(1);
+            }
+            break;
+        case OPT_MAX_HEAP: /* Size of the simulated heap */
+            if ((max_heap = parse_size(optarg)) == 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case OPT_PAGES: /* Report touched pages and RSS after the util pass */
+            page_stats = 1;
+            break;
+        case OPT_SEARCH: /* Report mm.c's average search length */
+            search_stats = 1;
+            break;
+        case OPT_FREE_LIST: /* How mm.c keeps its free blocks */
+            if (mm_parse_free_list(optarg, &free_list) < 0) {
+                fprintf(stderr, "Unknown free-list policy: %s\n", optarg);
+                usage();
+                exit(1);
+            }
+            mm_set_free_list(free_list);
+            break;
+        case OPT_PREDICT: /* Place blocks by predicted lifetime */
+            predict = 1;
+            mm_set_lifetime_prediction(1);
+            break;
+        case OPT_TIMER: /* How fsecs times each trace */
+            if (fsecs_parse_timer(optarg, &timer) < 0) {
+                fprintf(stderr, "Unknown timer: %s\n", optarg);
+                usage();
+                exit(1);
+            }
+            timer_given = 1;
+            break;
+        case OPT_SAMPLES: /* Time with fcyc's robust sampler */
+            robust_samples = atoi(optarg);
+            if (robust_samples < 3) {
+                fprintf(stderr, "--samples needs at least 3 samples\n");
+                exit(1);
+            }
+            set_fsecs_robust(robust_samples);
+            break;
+        case OPT_CACHE: /* Cache state before each fcyc sample */
+            if (fsecs_parse_cache(optarg, &cache) < 0) {
+                fprintf(stderr, "Unknown cache mode: %s\n", optarg);
+                usage();
+                exit(1);
+            }
+            cache_given = 1;
+            set_fsecs_cache(cache);
+            break;
+        case OPT_CPU: /* Pin the driver to one CPU */
+            cpu = atoi(optarg);
+            break;
+        case OPT_FIFO: /* Run under the real-time scheduler */
+            fifo = 1;
+            break;
+        case OPT_ALLOC: /* Compare mm.c against another allocator */
+            if (num_allocs == 0)
+                alloc_specs[num_allocs++] = "mm";
+            if (strcmp(optarg, "mm") == 0)
+                break;
+            if (num_allocs == MAX_ALLOCS) {
+                fprintf(stderr, "At most %d allocators can be compared\n",
+                        MAX_ALLOCS - 1);
+                exit(1);
+            }
+            alloc_specs[num_allocs++] = optarg;
+            break;
+        case OPT_COUNTERS: /* Count hardware events in each timed trace */
+            hw_counters = 1;
+            break;
+        case 'D': /* Run the mm package on a debug heap */
+            debug_heap = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -194,6 +516,23 @@ int main(int argc, char **argv) {
         }
     }
 
+    /*
+     * --samples and --cache are fcyc's, so they imply --timer fcyc,
+     * whatever order the options came in; with another timer they
+     * would be silently ignored, so that is an error.
+     */
+    if (robust_samples > 0 || cache_given) {
+        if (timer_given && timer != FSECS_FCYC) {
+            fprintf(stderr, "--samples and --cache need the fcyc timer, "
+                    "not --timer %s\n", fsecs_timer_name(timer));
+            exit(1);
+        }
+        timer = FSECS_FCYC;
+        timer_given = 1;
+    }
+    if (timer_given)
+        set_fsecs_timer(timer);
+
     /*
      * If no -f command line arg, then use the entire set of tracefiles
      * defined in default_traces[]
@@ -204,15 +543,105 @@ int main(int argc, char **argv) {
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /*
+     * A comparison needs several samples per trace for its significance
+     * test, on both sides, so results written for one to compare against
+     * get them too; otherwise each trace is timed once.
+     */
+    if (num_runs == 0)
+        num_runs = (baseline_file || json_file) ? COMPARE_MINRUNS : 1;
+
+    /*
+     * Workers that time their trace each get a CPU of their own, so
+     * never run more of them than there are CPUs to pin them to.
+     */
+    if (num_pin_cpus > 0 && num_jobs > num_pin_cpus)
+        num_jobs = num_pin_cpus;
+
+    /* Without workers, -P pins the driver itself, unless --cpu did */
+    if (num_pin_cpus > 0 && num_jobs <= 1 && cpu < 0)
+        cpu = pin_cpus[0];
+
+    /*
+     * Pin the driver down and check the clock before timing anything.
+     * Failing to get SCHED_FIFO (which needs privileges) isn't fatal.
+     */
+    benchenv_init(&env);
+    if (cpu >= 0 && benchenv_pin(&env, cpu) < 0) {
+        sprintf(msg, "Could not pin to CPU %d", cpu);
+        unix_error(msg);
+    }
+    if (fifo && benchenv_fifo(&env) < 0)
+        printf("Warning: could not switch to SCHED_FIFO (%s)\n",
+               strerror(errno));
+    benchenv_probe(&env);
+    if (verbose)
+        benchenv_print(&env, stdout);
+    benchenv_warn(&env, stdout);
+
     /* Initialize the timing package */
     init_fsecs();
 
+    /*
+     * The counters are often missing in VMs and containers; go on
+     * without them (or without the events that are missing)
+     */
+    if (hw_counters) {
+        int e, n = perfctr_available();
+
+        if (n == 0) {
+            printf("Hardware performance counters are not available "
+                   "(no PMU, or perf_event_paranoid too high); "
+                   "not counting.\n");
+            hw_counters = 0;
+        } else if (n < PERFCTR_NUM) {
+            printf("Not counting unavailable events:");
+            for (e = 0; e < PERFCTR_NUM; e++)
+                if (!perfctr_has(e))
+                    printf(" %s", perfctr_name(e));
+            printf("\n");
+        }
+        set_fsecs_counters(hw_counters);
+    }
+
+    /*
+     * Start the fragmentation profile. The file is reopened for append
+     * and line buffered so that -j workers can add whole rows to it.
+     */
+    if (frag_interval > 0) {
+        if ((frag_fp = fopen(frag_file, "w")) == NULL) {
+            sprintf(msg, "Could not open %s in main", frag_file);
+            unix_error(msg);
+        }
+        fprintf(frag_fp, "trace,file,op,live_bytes,heap_bytes,free_blocks,"
+                "free_bytes,largest_free,util\n");
+        fclose(frag_fp);
+        if ((frag_fp = fopen(frag_file, "a")) == NULL) {
+            sprintf(msg, "Could not open %s in main", frag_file);
+            unix_error(msg);
+        }
+        setvbuf(frag_fp, NULL, _IOLBF, 0);
+    }
+
+    /* Set up the per-op latency histograms */
+    if (latency_file) {
+        latencies = (latency_t *)calloc(num_tracefiles, sizeof(latency_t));
+        if (latencies == NULL)
+            unix_error("latencies calloc in main failed");
+        clock_overhead = ftimer_now_overhead();
+        if (verbose)
+            printf("Timing each request, less %lld ns of clock overhead.\n",
+                   clock_overhead);
+    }
+
     /*
      * Optionally run and evaluate the libc malloc package
      */
     if (run_libc) {
         if (verbose > 1)
             printf("\nTesting libc malloc\n");
+        if ((libc_alloc = allocator_open("libc")) == NULL)
+            app_error("Could not set up libc malloc");
 
         /* Allocate libc stats array, with one stats_t struct per tracefile */
         libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
@@ -220,20 +649,12 @@ int main(int argc, char **argv) {
             unix_error("libc_stats calloc in main failed");
 
         /* Evaluate the libc malloc package using the K-best scheme */
-        for (i = 0; i < num_tracefiles; i++) {
-            trace = read_trace(tracedir, tracefiles[i]);
-            libc_stats[i].ops = trace->num_ops;
-            if (verbose > 1)
-                printf("Checking libc malloc for correctness, ");
-            libc_stats[i].valid = eval_libc_valid(trace, i);
-            if (libc_stats[i].valid) {
-                speed_params.trace = trace;
-                if (verbose > 1)
-                    printf("and performance.\n");
-                libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-            }
-            free_trace(trace);
-        }
+        if (num_jobs > 1)
+            run_workers(tracefiles, num_tracefiles, libc_alloc, libc_stats);
+        else
+            for (i = 0; i < num_tracefiles; i++)
+                eval_alloc_trace(libc_alloc, tracefiles[i], i, 1,
+                                 &libc_stats[i]);
 
         /* Display the libc results in a compact table */
         if (verbose) {
@@ -253,28 +674,34 @@ int main(int argc, char **argv) {
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
 
-    /* Initialize the simulated memory system in memlib.c */
+    /*
+     * Initialize the simulated memory system in memlib.c. Counting
+     * touched pages needs a heap whose pages can be given back to the
+     * kernel between passes, which the malloc backend can't do.
+     */
+    if (page_stats && heap_backend == MEM_BACKEND_MALLOC)
+        heap_backend = MEM_BACKEND_MMAP;
+    mem_configure(heap_backend, max_heap, debug_heap ? MEM_HEAP_DEBUG : 0);
+    if (debug_heap) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = debug_heap_segv;
+        sa.sa_flags = SA_SIGINFO | SA_RESETHAND;
+        sigaction(SIGSEGV, &sa, NULL);
+    }
+    if (verbose > 1)
+        printf("Simulated heap: %lu bytes from %s\n",
+               (unsigned long)max_heap, mem_backend_name(heap_backend));
     mem_init();
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i = 0; i < num_tracefiles; i++) {
-        trace = read_trace(tracedir, tracefiles[i]);
-        mm_stats[i].ops = trace->num_ops;
-        if (verbose > 1)
-            printf("Checking mm_malloc for correctness, ");
-        mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-        if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-            speed_params.trace = trace;
-            speed_params.ranges = ranges;
-            if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-        }
-        free_trace(trace);
-    }
+    if (num_jobs > 1)
+        run_workers(tracefiles, num_tracefiles, NULL, mm_stats);
+    else
+        for (i = 0; i < num_tracefiles; i++)
+            eval_mm_trace(tracefiles[i], i, 1, &mm_stats[i],
+                          (latencies) ? &latencies[i] : NULL);
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -283,6 +710,55 @@ int main(int argc, char **argv) {
         printf("\n");
     }
 
+    /* Report the per-op latency percentiles */
+    if (latencies) {
+        printf("Latency percentiles for mm malloc (ns):\n");
+        printlatencies(num_tracefiles, mm_stats);
+        printf("\n");
+        if (*latency_file)
+            write_latency_csv(latency_file, tracefiles, num_tracefiles,
+                              mm_stats);
+    }
+
+    /* Report what the hardware counters saw */
+    if (hw_counters) {
+        printf("Hardware counters for mm malloc (per op):\n");
+        printcounters(num_tracefiles, mm_stats);
+        printf("\n");
+    }
+
+    /*
+     * Replay every trace against each allocator (mm.c included, so
+     * that it goes through exactly the same replay), each trace in a
+     * fresh process so that its peak RSS is its own
+     */
+    if (num_allocs > 0) {
+        int a;
+
+        for (a = 0; a < num_allocs; a++) {
+            if ((allocs[a] = allocator_open(alloc_specs[a])) == NULL)
+                exit(1);
+            for (i = 0; i < a; i++) {
+                if (strcmp(allocs[i]->name, allocs[a]->name) == 0) {
+                    fprintf(stderr, "Allocator %s is named twice\n",
+                            allocs[a]->name);
+                    exit(1);
+                }
+            }
+            alloc_stats[a] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+            if (alloc_stats[a] == NULL)
+                unix_error("alloc_stats calloc in main failed");
+            if (verbose > 1)
+                printf("\nTesting %s\n", allocs[a]->name);
+            for (i = 0; i < num_tracefiles; i++)
+                run_alloc_trace(allocs[a], tracefiles[i], i,
+                                &alloc_stats[a][i]);
+        }
+        printf("Allocator comparison (Kops, payload over usable size, peak RSS growth in KB):\n");
+        printallocators(num_tracefiles, num_allocs, allocs, alloc_stats);
+        printf("\n");
+    }
+
     /*
      * Accumulate the aggregate statistics for the student's mm package
      */
@@ -319,6 +795,7 @@ int main(int argc, char **argv) {
                p2*100,
                perfindex);
     } else { /* There were errors */
+        p1 = p2 = 0.0;
         perfindex = 0.0;
         printf("Terminated with %d errors\n", errors);
     }
@@ -328,6 +805,21 @@ int main(int argc, char **argv) {
         printf("perfidx:%.0f\n", perfindex);
     }
 
+    if (frag_fp) {
+        fclose(frag_fp);
+        printf("Wrote fragmentation profile to %s\n", frag_file);
+    }
+
+    if (json_file)
+        write_json(json_file, tracefiles, num_tracefiles, mm_stats,
+                   libc_stats, num_allocs, allocs, alloc_stats,
+                   p1, p2, perfindex);
+
+    /* Exit with status 2 if any trace regressed against the baseline */
+    if (baseline_file &&
+        compare_results(baseline_file, tracefiles, num_tracefiles, mm_stats) > 0)
+        exit(2);
+
     exit(0);
 }
 
@@ -371,6 +863,23 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
+    /*
+     * On a debug heap, the shadow map knows which bytes belong to live
+     * payloads, so overlaps are found without walking the range list.
+     * The payload is inside the heap, checked above, so the only way
+     * marking it can fail is an overlap.
+     */
+    if (debug_heap) {
+        if (mem_heap_shadow_mark(mem_default_heap(), lo, size) < 0) {
+            examine_heap();
+            sprintf(msg, "Payload (%p:%p) overlaps another payload\n",
+                    lo, hi);
+            malloc_error(tracenum, opnum, msg);
+            return 0;
+        }
+        return 1;
+    }
+
     /* The payload must not overlap any other payloads */
     for (p = *ranges;  p != NULL;  p = p->next) {
         if ((lo >= p->lo && lo <= p-> hi) ||
@@ -404,6 +913,11 @@ static void remove_range(range_t **ranges, char *lo) {
     range_t **prevpp = ranges;
     // int size;
 
+    if (debug_heap) {
+        mem_heap_shadow_unmark(mem_default_heap(), lo);
+        return;
+    }
+
     for (p = *ranges;  p != NULL; p = p->next) {
         if (p->lo == lo) {
             *prevpp = p->next;
@@ -429,6 +943,30 @@ static void clear_ranges(range_t **ranges) {
     *ranges = NULL;
 }
 
+/*
+ * check_payload - On a debug heap, make sure that the payload of block
+ *     index still holds the fill byte eval_mm_valid wrote into it, i.e.
+ *     that the allocator hasn't scribbled on a block it handed out.
+ */
+static int check_payload(trace_t *trace, int index, int tracenum,
+                         int opnum) {
+    unsigned char *p = (unsigned char *)trace->blocks[index];
+    size_t j;
+    char msg[MAXLINE];
+
+    if (!debug_heap)
+        return 1;
+    for (j = 0; j < trace->block_sizes[index]; j++) {
+        if (p[j] != (index & 0xFF)) {
+            sprintf(msg, "Payload of block %d was overwritten at %p "
+                    "while it was allocated", index, (void *)(p + j));
+            malloc_error(tracenum, opnum, msg);
+            return 0;
+        }
+    }
+    return 1;
+}
+
 
 /**********************************************
  * The following routines manipulate tracefiles
@@ -442,7 +980,7 @@ static trace_t *read_trace(char *tracedir, char *filename) {
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, arg;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -452,6 +990,7 @@ static trace_t *read_trace(char *tracedir, char *filename) {
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trance");
+    trace->filename = filename;
 
     /* Read the trace file header */
     strcpy(path, tracedir);
@@ -492,6 +1031,45 @@ static trace_t *read_trace(char *tracedir, char *filename) {
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'r':
+            fscanf(tracefile, "%u %u", &index, &size);
+            trace->ops[op_index].type = REALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'c':
+            /* c <id> <nmemb> <size>: size is the size of each element */
+            fscanf(tracefile, "%u %u %u", &index, &arg, &size);
+            if (arg == 0) {
+                printf("Bogus calloc nmemb (0) in tracefile %s\n", path);
+                exit(1);
+            }
+            if (size == 0 || arg > INT_MAX / size) {
+                printf("Bogus calloc size (%u x %u) in tracefile %s\n",
+                       arg, size, path);
+                exit(1);
+            }
+            trace->ops[op_index].type = CALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = arg * size;
+            trace->ops[op_index].arg = arg;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'm':
+            /* m <id> <alignment> <size> */
+            fscanf(tracefile, "%u %u %u", &index, &arg, &size);
+            if (arg < sizeof(void *) || (arg & (arg - 1)) != 0) {
+                printf("Bogus memalign alignment (%u) in tracefile %s\n",
+                       arg, path);
+                exit(1);
+            }
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].arg = arg;
+            max_index = (index > max_index) ? index : max_index;
+            break;
         case 'f':
             fscanf(tracefile, "%ud", &index);
             trace->ops[op_index].type = FREE;
@@ -531,10 +1109,11 @@ void free_trace(trace_t *trace) {
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
-    int i;
+    int i, j;
     int index;
     int size;
-    char *p;
+    int oldsize;
+    char *p, *newp, *oldp;
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -553,10 +1132,33 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
 
         switch (trace->ops[i].type) {
         case ALLOC: /* mm_malloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+
+            /* Call the student's malloc, calloc, or memalign */
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL) {
+                sprintf(msg, "mm_%s failed.",
+                        latency_opnames[latency_op(&trace->ops[i])]);
+                malloc_error(tracenum, i, msg);
+                return 0;
+            }
+
+            /* A calloc'd block must come back zeroed... */
+            if (trace->ops[i].type == CALLOC) {
+                for (j = 0; j < size; j++) {
+                    if (p[j] != 0) {
+                        malloc_error(tracenum, i, "mm_calloc did not zero "
+                                     "the block");
+                        return 0;
+                    }
+                }
+            }
 
-            /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(tracenum, i, "mm_malloc failed.");
+            /* ...and a memalign'd block must have the requested alignment */
+            if (trace->ops[i].type == MEMALIGN &&
+                ((size_t)p % trace->ops[i].arg) != 0) {
+                malloc_error(tracenum, i, "mm_memalign returned a block "
+                             "with the wrong alignment");
                 return 0;
             }
 
@@ -580,9 +1182,50 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
             trace->block_sizes[index] = size;
             break;
 
+        case REALLOC: /* mm_realloc */
+
+            /* Call the student's realloc */
+            if (!check_payload(trace, index, tracenum, i))
+                return 0;
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, size)) == NULL) {
+                malloc_error(tracenum, i, "mm_realloc failed.");
+                return 0;
+            }
+
+            /* Remove the old region from the range list */
+            remove_range(ranges, oldp);
+
+            /* Check new block for correctness and add it to range list */
+            if (add_range(ranges, newp, size, tracenum, i) == 0)
+                return 0;
+
+            /* ADDED: cgw
+             * Make sure that the new block contains the data from the old
+             * block and then fill in the new block with the low order byte
+             * of the new index
+             */
+            oldsize = trace->block_sizes[index];
+            if (size < oldsize) oldsize = size;
+            for (j = 0; j < oldsize; j++) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
+                    malloc_error(tracenum, i, "mm_realloc did not preserve the "
+                                 "data from old block");
+                    return 0;
+                }
+            }
+            memset(newp, index & 0xFF, size);
+
+            /* Remember region */
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = size;
+            break;
+
         case FREE: /* mm_free */
 
             /* Remove region from list and call student's free function */
+            if (!check_payload(trace, index, tracenum, i))
+                return 0;
             p = trace->blocks[index];
             remove_range(ranges, p);
             mm_free(p);
@@ -607,14 +1250,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   package on the trace. Note that our implementation of mem_sbrk()
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap.
+ *
+ *   With --frag, it also samples the state of the heap every
+ *   frag_interval ops (see sample_frag).
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
     int i;
     int index;
-    int size;
-    int max_total_size = 0;
-    int total_size = 0;
-    char *p;
+    int size, newsize, oldsize;
+    long max_total_size = 0;
+    long total_size = 0;
+    char *p, *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
@@ -624,10 +1270,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* mm_alloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
                 app_error("mm_malloc failed in eval_mm_util");
 
             /* Remember region and size */
@@ -643,6 +1291,28 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
                 total_size : max_total_size;
             break;
 
+        case REALLOC: /* mm_realloc */
+            index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+            oldsize = trace->block_sizes[index];
+
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+                app_error("mm_realloc failed in eval_mm_util");
+
+            /* Remember region and size */
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
+
+            /* Keep track of current total size
+             * of all allocated blocks */
+            total_size += (newsize - oldsize);
+
+            /* Update statistics */
+            max_total_size = (total_size > max_total_size) ?
+                total_size : max_total_size;
+            break;
+
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             size = trace->block_sizes[index];
@@ -659,19 +1329,44 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
         default:
             app_error("Nonexistent request type in eval_mm_util");
         }
+
+        if (frag_fp &&
+            (i % frag_interval == 0 || i == trace->num_ops - 1))
+            sample_frag(trace, tracenum, i, total_size);
     }
 
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * sample_frag - Append one row to the fragmentation profile: the live
+ *   payload bytes and heap size after request opnum, along with the
+ *   number, total size, and largest of the free blocks as reported by
+ *   the mm package's mm_heapstats hook.
+ */
+static void sample_frag(trace_t *trace, int tracenum, int opnum,
+                        long live_bytes) {
+    mm_heapstats_t hs;
+    size_t heap_bytes = mem_heapsize();
+
+    mm_heapstats(&hs);
+    fprintf(frag_fp, "%d,%s,%d,%ld,%lu,%lu,%lu,%lu,%.4f\n",
+            tracenum, trace->filename, opnum, live_bytes,
+            (unsigned long)heap_bytes,
+            (unsigned long)hs.free_blocks,
+            (unsigned long)hs.free_bytes,
+            (unsigned long)hs.largest_free,
+            (heap_bytes > 0) ? (double)live_bytes / heap_bytes : 0.0);
+}
+
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
-    int i, index, size;
-    char *p, *block;
+    int i, index, size, newsize;
+    char *p, *block, *oldp, *newp;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
@@ -690,6 +1385,23 @@ static void eval_mm_speed(void *ptr) {
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
+                app_error("mm_calloc/mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+                app_error("mm_realloc error in eval_mm_speed");
+            trace->blocks[index] = newp;
+            break;
+
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
@@ -697,71 +1409,611 @@ static void eval_mm_speed(void *ptr) {
             break;
 
         default:
-            app_error("Nonexistent request type in eval_mm_valid");
+            app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * mm_alloc_op - Hand an ALLOC, CALLOC, or MEMALIGN request to the
+ *    matching mm package routine. For CALLOC, op->size is the total
+ *    payload size, so the element size is op->size / op->arg.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum) {
-    int i;
+static char *mm_alloc_op(traceop_t *op) {
+    switch (op->type) {
+    case CALLOC:
+        return mm_calloc(op->arg, op->size / op->arg);
+    case MEMALIGN:
+        return mm_memalign(op->arg, op->size);
+    default:
+        return mm_malloc(op->size);
+    }
+}
+
+/*
+ * latency_op - Return the LAT_* histogram (and name) for a request
+ */
+static int latency_op(traceop_t *op) {
+    switch (op->type) {
+    case ALLOC:
+        return LAT_MALLOC;
+    case FREE:
+        return LAT_FREE;
+    case REALLOC:
+        return LAT_REALLOC;
+    case CALLOC:
+        return LAT_CALLOC;
+    default:
+        return LAT_MEMALIGN;
+    }
+}
+
+/*
+ * eval_mm_latency - Replay the trace once more, timing each request on
+ *    its own with the monotonic clock. Each latency, less the clock's
+ *    own overhead, is recorded in the histogram for its request type.
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat) {
+    int i, index, size;
+    int op;
     char *p;
+    long long start, elapsed;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
 
+    for (i = 0;  i < LAT_NUMOPS;  i++)
+        hist_init(&lat->hists[i]);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+            size = trace->ops[i].size;
+            start = ftimer_now_ns();
+            p = mm_malloc(size);
+            elapsed = ftimer_now_ns() - start - clock_overhead;
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            hist_record(&lat->hists[LAT_MALLOC], (elapsed > 0) ? elapsed : 0);
+            break;
+
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+            op = latency_op(&trace->ops[i]);
+            start = ftimer_now_ns();
+            p = mm_alloc_op(&trace->ops[i]);
+            elapsed = ftimer_now_ns() - start - clock_overhead;
+            if (p == NULL)
+                app_error("mm_calloc/mm_memalign error in eval_mm_latency");
+            trace->blocks[index] = p;
+            hist_record(&lat->hists[op], (elapsed > 0) ? elapsed : 0);
+            break;
+
+        case REALLOC: /* mm_realloc */
+            size = trace->ops[i].size;
+            start = ftimer_now_ns();
+            p = mm_realloc(trace->blocks[index], size);
+            elapsed = ftimer_now_ns() - start - clock_overhead;
+            if (p == NULL)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            hist_record(&lat->hists[LAT_REALLOC], (elapsed > 0) ? elapsed : 0);
+            break;
+
+        case FREE: /* mm_free */
+            p = trace->blocks[index];
+            start = ftimer_now_ns();
+            mm_free(p);
+            elapsed = ftimer_now_ns() - start - clock_overhead;
+            hist_record(&lat->hists[LAT_FREE], (elapsed > 0) ? elapsed : 0);
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+    }
+}
+
+/*
+ * eval_alloc_valid - Replay a trace against alloc, to make sure it can
+ *    run to completion and to measure its utilization. We'll be
+ *    conservative and terminate if any call fails. Utilization is the
+ *    peak payload over the peak total of usable_size (for mm.c, too,
+ *    so that all allocators are measured alike), or, for an allocator
+ *    that can't tell us that, over its final heap size.
+ */
+static int eval_alloc_valid(allocator_t *alloc, trace_t *trace, int tracenum,
+                            stats_t *stats) {
+    int i, index;
+    char *p, *newp;
+    long live = 0, max_live = 0;
+    long usable = 0, max_usable = 0;
+
+    if (alloc->init && alloc->init() < 0) {
+        malloc_error(tracenum, 0, "allocator init failed");
+        return 0;
+    }
     for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
-                malloc_error(tracenum, i, "libc malloc failed");
+        case CALLOC: /* calloc */
+        case MEMALIGN: /* posix_memalign */
+            if ((p = alloc_op(alloc, &trace->ops[i])) == NULL) {
+                sprintf(msg, "%s malloc/calloc/memalign failed", alloc->name);
+                malloc_error(tracenum, i, msg);
+                unix_error("System message");
+            }
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            live += trace->ops[i].size;
+            if (alloc->usable_size)
+                usable += alloc->usable_size(p);
+            break;
+
+        case REALLOC: /* realloc */
+            p = trace->blocks[index];
+            if (alloc->usable_size && p)
+                usable -= alloc->usable_size(p);
+            if ((newp = alloc->realloc(p, trace->ops[i].size)) == NULL) {
+                sprintf(msg, "%s realloc failed", alloc->name);
+                malloc_error(tracenum, i, msg);
                 unix_error("System message");
             }
-            trace->blocks[trace->ops[i].index] = p;
+            trace->blocks[index] = newp;
+            live += trace->ops[i].size - trace->block_sizes[index];
+            trace->block_sizes[index] = trace->ops[i].size;
+            if (alloc->usable_size)
+                usable += alloc->usable_size(newp);
             break;
 
         case FREE: /* free */
-           free(trace->blocks[trace->ops[i].index]);
-           break;
-                default:
-            app_error("invalid operation type  in eval_libc_valid");
+            p = trace->blocks[index];
+            if (alloc->usable_size && p)
+                usable -= alloc->usable_size(p);
+            alloc->free(p);
+            live -= trace->block_sizes[index];
+            trace->block_sizes[index] = 0;
+            break;
+
+        default:
+            app_error("invalid operation type  in eval_alloc_valid");
         }
+        if (live > max_live)
+            max_live = live;
+        if (usable > max_usable)
+            max_usable = usable;
     }
 
+    if (max_usable > 0)
+        stats->util = (double)max_live / max_usable;
+    else if (alloc->heap_size && alloc->heap_size() > 0)
+        stats->util = (double)max_live / alloc->heap_size();
     return 1;
 }
 
 /*
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+ * eval_alloc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of an allocator on a trace.
  */
-static void eval_libc_speed(void *ptr) {
+static void eval_alloc_speed(void *ptr) {
     int i;
-    int index, size;
-    char *p, *block;
+    int index;
+    char *p, *newp;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    allocator_t *alloc = ((speed_t *)ptr)->alloc;
 
+    if (alloc->init && alloc->init() < 0)
+        app_error("allocator init failed in eval_alloc_speed");
     for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
-                unix_error("malloc failed in eval_libc_speed");
+        case CALLOC: /* calloc */
+        case MEMALIGN: /* posix_memalign */
+            if ((p = alloc_op(alloc, &trace->ops[i])) == NULL)
+                unix_error("malloc/calloc/memalign failed in eval_alloc_speed");
             trace->blocks[index] = p;
             break;
 
+        case REALLOC: /* realloc */
+            if ((newp = alloc->realloc(trace->blocks[index],
+                                       trace->ops[i].size)) == NULL)
+                unix_error("realloc failed in eval_alloc_speed");
+            trace->blocks[index] = newp;
+            break;
+
         case FREE: /* free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            free(block);
+            alloc->free(trace->blocks[index]);
             break;
         }
     }
 }
 
+/*
+ * alloc_op - allocator_t counterpart of mm_alloc_op
+ */
+static char *alloc_op(allocator_t *alloc, traceop_t *op) {
+    void *p;
+
+    switch (op->type) {
+    case CALLOC:
+        return alloc->calloc(op->arg, op->size / op->arg);
+    case MEMALIGN:
+        if ((errno = alloc->posix_memalign(&p, op->arg, op->size)) != 0)
+            return NULL;
+        return p;
+    default:
+        return alloc->malloc(op->size);
+    }
+}
+
+/*******************************************************************
+ * The following routines evaluate one trace at a time, either in the
+ * main process or in a forked worker when running with -j
+ ******************************************************************/
+
+/*
+ * eval_alloc_trace - Check an allocator for correctness and utilization
+ *     on one trace and, if timed is set, measure its throughput.
+ */
+static void eval_alloc_trace(allocator_t *alloc, char *filename,
+                             int tracenum, int timed, stats_t *stats) {
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+        printf("Checking %s for correctness, ", alloc->name);
+    stats->valid = eval_alloc_valid(alloc, trace, tracenum, stats);
+    if (stats->valid && timed) {
+        speed_params.trace = trace;
+        speed_params.alloc = alloc;
+        if (verbose > 1)
+            printf("and performance.\n");
+        time_trace(eval_alloc_speed, &speed_params, stats);
+    }
+    free_trace(trace);
+}
+
+/*
+ * run_alloc_trace - Evaluate an allocator on one trace in a forked
+ *     child, and record how much its resident set grew at the peak.
+ *     mm.c gets a fresh simulated heap, and the child resets its RSS
+ *     high-water mark before starting, so the growth is the trace's.
+ */
+static void run_alloc_trace(allocator_t *alloc, char *filename, int tracenum,
+                            stats_t *stats) {
+    int fds[2], status;
+    pid_t pid;
+    result_t result;
+    struct rusage ru;
+    size_t start;
+    FILE *fp;
+
+    if (pipe(fds) < 0)
+        unix_error("pipe failed in run_alloc_trace");
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        unix_error("fork failed in run_alloc_trace");
+
+    if (pid == 0) {
+        close(fds[0]);
+        memset(&result, 0, sizeof(result));
+        errors = 0;
+        if (alloc->heap_size) {
+            mem_deinit();
+            mem_init();
+        }
+        if ((fp = fopen("/proc/self/clear_refs", "w")) != NULL) {
+            fputs("5", fp);  /* reset the high-water mark (Linux 4.0+) */
+            fclose(fp);
+        }
+        start = mem_rss();
+        eval_alloc_trace(alloc, filename, tracenum, 1, &result.stats);
+        getrusage(RUSAGE_SELF, &ru);
+        if ((size_t)ru.ru_maxrss * 1024 > start)
+            result.stats.rss = (size_t)ru.ru_maxrss * 1024 - start;
+        result.errors = errors;
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+            unix_error("write failed in run_alloc_trace");
+        exit(0);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &result, sizeof(result)) == sizeof(result)) {
+        *stats = result.stats;
+        errors += result.errors;
+    } else {
+        errors++;
+        stats->valid = 0;
+    }
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    if (!stats->valid)
+        printf("ERROR [trace %d]: %s terminated abnormally (status 0x%x)\n",
+               tracenum, alloc->name, status);
+}
+
+/*
+ * eval_mm_trace - Check the mm package for correctness and space
+ *     utilization on one trace and, if timed is set, measure its
+ *     throughput. If lat isn't NULL, also record per-op latencies.
+ */
+static void eval_mm_trace(char *filename, int tracenum, int timed,
+                          stats_t *stats, latency_t *lat) {
+    trace_t *trace;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    mm_heapstats_t hs;
+
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+        printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+        if (verbose > 1)
+            printf("efficiency, ");
+        if (page_stats)
+            mem_heap_discard(mem_default_heap());
+        stats->util = eval_mm_util(trace, tracenum, &ranges);
+        if (page_stats) {
+            stats->pages = mem_heap_touched(mem_default_heap());
+            stats->rss = mem_rss();
+        }
+        if (search_stats) {
+            mm_heapstats(&hs);
+            stats->search = hs.searches ?
+                (double)hs.search_steps / hs.searches : 0.0;
+        }
+        if (timed) {
+            speed_params.trace = trace;
+            speed_params.ranges = ranges;
+            if (verbose > 1)
+                printf("and performance.\n");
+            time_trace(eval_mm_speed, &speed_params, stats);
+        }
+        if (lat)
+            eval_mm_latency(trace, lat);
+    }
+    clear_ranges(&ranges);
+    free_trace(trace);
+}
+
+/*
+ * run_workers - Evaluate each trace in its own forked worker, running
+ *     at most num_jobs workers at once. Each worker sends its stats back
+ *     through a pipe. Workers only measure throughput when they are
+ *     pinned to CPUs of their own (-P); otherwise the traces are timed
+ *     here one at a time once the workers are done, so that concurrent
+ *     workers can't disturb the measurements. Per-op latencies are
+ *     always taken here, since the histograms are too big for a pipe.
+ */
+static void run_workers(char **tracefiles, int n, allocator_t *alloc,
+                        stats_t *stats) {
+    worker_t *workers;
+    result_t result;
+    int timed = (num_pin_cpus > 0);
+    int next = 0;
+    int running = 0;
+    int slot, status;
+    pid_t pid;
+    trace_t *trace;
+    speed_t speed_params;
+
+    if ((workers = (worker_t *)calloc(num_jobs, sizeof(worker_t))) == NULL)
+        unix_error("calloc failed in run_workers");
+
+    while (next < n || running > 0) {
+        /* Hand the next traces to any idle slots */
+        for (slot = 0; slot < num_jobs && next < n; slot++) {
+            if (workers[slot].pid == 0) {
+                start_worker(&workers[slot], slot, tracefiles[next], next,
+                             alloc, timed);
+                next++;
+                running++;
+            }
+        }
+
+        /* Reap one worker and collect its results */
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait failed in run_workers");
+        for (slot = 0; slot < num_jobs; slot++)
+            if (workers[slot].pid == pid)
+                break;
+        if (slot == num_jobs)
+            continue;
+
+        if (read(workers[slot].fd, &result, sizeof(result)) == sizeof(result)) {
+            stats[workers[slot].tracenum] = result.stats;
+            errors += result.errors;
+        } else {
+            errors++;
+            printf("ERROR [trace %d]: worker terminated abnormally (status 0x%x)\n",
+                   workers[slot].tracenum, status);
+            stats[workers[slot].tracenum].valid = 0;
+        }
+        close(workers[slot].fd);
+        workers[slot].pid = 0;
+        running--;
+    }
+    free(workers);
+
+    if (timed && (alloc || latencies == NULL))
+        return;
+
+    /* Time the valid traces serially */
+    for (next = 0; next < n; next++) {
+        if (!stats[next].valid)
+            continue;
+        trace = read_trace(tracedir, tracefiles[next]);
+        speed_params.trace = trace;
+        speed_params.alloc = alloc;
+        if (!timed && alloc)
+            time_trace(eval_alloc_speed, &speed_params, &stats[next]);
+        else if (!timed)
+            time_trace(eval_mm_speed, &speed_params, &stats[next]);
+        if (!alloc && latencies)
+            eval_mm_latency(trace, &latencies[next]);
+        free_trace(trace);
+    }
+}
+
+/*
+ * time_trace - Time f on a trace num_runs times, keeping each run's
+ *     time as a sample. The trace's secs is the median of the samples.
+ *     If the timer gives confidence intervals, the trace's interval
+ *     runs from the median low bound to the median high bound.
+ */
+static void time_trace(fsecs_test_funct f, speed_t *params, stats_t *stats) {
+    double sorted[COMPARE_MAXRUNS];
+    double lo[COMPARE_MAXRUNS], hi[COMPARE_MAXRUNS];
+    int r;
+
+    stats->nsamples = num_runs;
+    stats->has_ci = 1;
+    for (r = 0; r < num_runs; r++) {
+        stats->samples[r] = fsecs(f, params);
+        stats->has_ci &= fsecs_interval(&lo[r], &hi[r]);
+    }
+    memcpy(sorted, stats->samples, num_runs * sizeof(double));
+    stats->secs = median(sorted, num_runs);
+    if (stats->has_ci) {
+        stats->secs_lo = median(lo, num_runs);
+        stats->secs_hi = median(hi, num_runs);
+    }
+    stats->counted = fsecs_counters(&stats->counters);
+}
+
+/*
+ * start_worker - Fork a worker into slot that evaluates one trace and
+ *     writes a result_t to its end of the pipe.
+ */
+static void start_worker(worker_t *w, int slot, char *filename,
+                         int tracenum, allocator_t *alloc, int timed) {
+    int fds[2];
+    pid_t pid;
+    result_t result;
+
+    if (pipe(fds) < 0)
+        unix_error("pipe failed in start_worker");
+
+    fflush(stdout); /* don't let the child inherit buffered output */
+    if ((pid = fork()) < 0)
+        unix_error("fork failed in start_worker");
+
+    if (pid == 0) {
+        close(fds[0]);
+        if (timed)
+            pin_to_cpu(pin_cpus[slot]);
+
+        memset(&result, 0, sizeof(result));
+        errors = 0;
+        if (alloc) {
+            eval_alloc_trace(alloc, filename, tracenum, timed, &result.stats);
+        } else {
+            /* Give the worker a simulated heap of its own */
+            mem_deinit();
+            mem_init();
+            eval_mm_trace(filename, tracenum, timed, &result.stats, NULL);
+        }
+        result.errors = errors;
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+            unix_error("write failed in start_worker");
+        exit(0);
+    }
+
+    close(fds[1]);
+    w->pid = pid;
+    w->fd = fds[0];
+    w->tracenum = tracenum;
+}
+
+/*
+ * pin_to_cpu - Restrict the calling process to run only on cpu
+ */
+static void pin_to_cpu(int cpu) {
+    cpu_set_t mask;
+
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) < 0) {
+        sprintf(msg, "sched_setaffinity to CPU %d failed", cpu);
+        unix_error(msg);
+    }
+}
+
+/*
+ * parse_cpulist - Parse a CPU list such as "2,4-7" into a malloc'd
+ *     array. Returns the number of CPUs, or 0 if the list is malformed
+ *     or names a CPU we aren't allowed to run on.
+ */
+static int parse_cpulist(char *list, int **cpus) {
+    int n = 0;
+    int lo, hi, cpu;
+    char *s = list;
+    char *end;
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        unix_error("sched_getaffinity failed in parse_cpulist");
+
+    if ((*cpus = (int *)malloc(CPU_SETSIZE * sizeof(int))) == NULL)
+        unix_error("malloc failed in parse_cpulist");
+
+    while (*s) {
+        lo = hi = (int)strtol(s, &end, 10);
+        if (end == s || lo < 0)
+            return 0;
+        s = end;
+        if (*s == '-') {
+            s++;
+            hi = (int)strtol(s, &end, 10);
+            if (end == s || hi < lo)
+                return 0;
+            s = end;
+        }
+        for (cpu = lo; cpu <= hi && n < CPU_SETSIZE; cpu++) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+                fprintf(stderr, "CPU %d is not available\n", cpu);
+                return 0;
+            }
+            (*cpus)[n++] = cpu;
+        }
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return 0;
+    }
+    return n;
+}
+
+/*
+ * parse_size - parse a byte count with an optional K, M, or G suffix.
+ *    Returns 0 if the string is not a valid nonzero size.
+ */
+static size_t parse_size(char *s) {
+    char *end;
+    unsigned long long n;
+
+    errno = 0;
+    n = strtoull(s, &end, 10);
+    if (errno != 0 || end == s)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+    }
+    if (*end != '\0')
+        return 0;
+    return (size_t)n;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -777,17 +2029,35 @@ static void printresults(int n, stats_t *stats) {
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%8s\n",
+    printf("%5s%7s %5s%8s%10s%8s",
            "trace", " valid", "util", "ops", "secs", "Kops");
+    if (robust_samples)
+        printf("%8s", "+/-");
+    if (page_stats)
+        printf("%8s%9s", "pages", "rssKB");
+    if (search_stats)
+        printf("%8s", "search");
+    printf("\n");
     for (i = 0; i < n; i++) {
         if (stats[i].valid) {
-            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f\n",
+            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f",
                    i,
                    "yes",
                    stats[i].util*100.0,
                    stats[i].ops,
                    stats[i].secs,
                    (stats[i].ops/1e3)/stats[i].secs);
+            if (robust_samples && stats[i].has_ci)
+                printf("%7.1f%%", 50.0 * (stats[i].secs_hi - stats[i].secs_lo)
+                       / stats[i].secs);
+            else if (robust_samples)
+                printf("%8s", "-");
+            if (page_stats && stats[i].rss > 0)
+                printf("%8lu%9lu", (unsigned long)stats[i].pages,
+                       (unsigned long)(stats[i].rss / 1024));
+            if (search_stats)
+                printf("%8.1f", stats[i].search);
+            printf("\n");
             secs += stats[i].secs;
             ops += stats[i].ops;
             util += stats[i].util;
@@ -820,6 +2090,352 @@ static void printresults(int n, stats_t *stats) {
     }
 }
 
+/*
+ * printlatencies - prints the per-op latency percentiles of each trace
+ */
+static void printlatencies(int n, stats_t *stats) {
+    int i, op;
+    hist_t *h;
+
+    printf("%5s %-8s%9s%8s%8s%8s%8s%9s\n",
+           "trace", "op", "count", "p50", "p90", "p99", "p999", "max");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        for (op = 0; op < LAT_NUMOPS; op++) {
+            h = &latencies[i].hists[op];
+            if (h->total == 0)
+                continue;
+            printf("%2d    %-8s%9lu%8lu%8lu%8lu%8lu%9lu\n",
+                   i,
+                   latency_opnames[op],
+                   h->total,
+                   hist_percentile(h, 50.0),
+                   hist_percentile(h, 90.0),
+                   hist_percentile(h, 99.0),
+                   hist_percentile(h, 99.9),
+                   h->max);
+        }
+    }
+}
+
+/*
+ * printcounters - prints IPC and per-op event counts for each trace,
+ *     with "-" for events that couldn't be counted
+ */
+static void printcounters(int n, stats_t *stats) {
+    int i, e;
+    long long *c;
+    static const int per_op[] = {PERFCTR_INSTRUCTIONS, PERFCTR_CACHE_MISSES,
+                                 PERFCTR_BRANCH_MISSES, PERFCTR_DTLB_MISSES};
+
+    printf("%5s%7s%10s%10s%10s%10s\n",
+           "trace", "IPC", "instrs", "LLCmiss", "brmiss", "dTLBmiss");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || !stats[i].counted)
+            continue;
+        c = stats[i].counters.count;
+        printf("%2d   ", i);
+        if (c[PERFCTR_CYCLES] > 0 && c[PERFCTR_INSTRUCTIONS] >= 0)
+            printf("%7.2f", (double)c[PERFCTR_INSTRUCTIONS] /
+                   c[PERFCTR_CYCLES]);
+        else
+            printf("%7s", "-");
+        for (e = 0; e < sizeof(per_op) / sizeof(per_op[0]); e++) {
+            if (c[per_op[e]] >= 0)
+                printf("%10.3f", c[per_op[e]] / stats[i].ops);
+            else
+                printf("%10s", "-");
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * printallocators - prints each allocator's throughput, utilization,
+ *     and peak RSS growth side by side for each trace
+ */
+static void printallocators(int n, int nalloc, allocator_t **allocs,
+                            stats_t **stats) {
+    int i, a;
+    double ops, secs;
+    stats_t *st;
+    size_t len;
+
+    /* Paths are shown by their last 20 characters, to fit the column */
+    printf("%5s", "trace");
+    for (a = 0; a < nalloc; a++) {
+        len = strlen(allocs[a]->name);
+        printf("%22s", len > 20 ? allocs[a]->name + len - 20 : allocs[a]->name);
+    }
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        printf("%2d   ", i);
+        for (a = 0; a < nalloc; a++) {
+            st = &stats[a][i];
+            if (!st->valid) {
+                printf("%22s", "-");
+                continue;
+            }
+            printf("%8.0f", (st->ops/1e3)/st->secs);
+            if (st->util > 0)
+                printf("%5.0f%%", st->util*100.0);
+            else
+                printf("%6s", "-");
+            printf("%8lu", (unsigned long)(st->rss / 1024));
+        }
+        printf("\n");
+    }
+    printf("%-5s", "Total");
+    for (a = 0; a < nalloc; a++) {
+        ops = secs = 0;
+        for (i = 0; i < n; i++) {
+            if (stats[a][i].valid) {
+                ops += stats[a][i].ops;
+                secs += stats[a][i].secs;
+            }
+        }
+        if (secs > 0)
+            printf("%8.0f%14s", (ops/1e3)/secs, "");
+        else
+            printf("%22s", "-");
+    }
+    printf("\n");
+}
+
+/*
+ * write_latency_csv - export the per-op latency percentiles as CSV
+ */
+static void write_latency_csv(char *filename, char **tracefiles, int n,
+                              stats_t *stats) {
+    FILE *fp;
+    int i, op;
+    hist_t *h;
+
+    if ((fp = fopen(filename, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_latency_csv", filename);
+        unix_error(msg);
+    }
+    fprintf(fp, "trace,file,op,count,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        for (op = 0; op < LAT_NUMOPS; op++) {
+            h = &latencies[i].hists[op];
+            if (h->total == 0)
+                continue;
+            fprintf(fp, "%d,%s,%s,%lu,%.1f,%lu,%lu,%lu,%lu,%lu\n",
+                    i, tracefiles[i], latency_opnames[op], h->total,
+                    hist_mean(h),
+                    hist_percentile(h, 50.0),
+                    hist_percentile(h, 90.0),
+                    hist_percentile(h, 99.0),
+                    hist_percentile(h, 99.9),
+                    h->max);
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * json_string - write s as a JSON string literal
+ */
+static void json_string(FILE *fp, char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * json_stats - write the per-trace and total results of one malloc
+ *     package as a JSON object
+ */
+static void json_stats(FILE *fp, char **tracefiles, int n, stats_t *stats) {
+    int i, r, e;
+    double secs = 0, ops = 0, util = 0;
+
+    fprintf(fp, "{\n    \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "      {\"trace\": %d, \"file\": ", i);
+        json_string(fp, tracefiles[i]);
+        fprintf(fp, ", \"valid\": %s", stats[i].valid ? "true" : "false");
+        if (stats[i].valid) {
+            fprintf(fp, ", \"util\": %.6f, \"ops\": %.0f, \"secs\": %.9f, "
+                    "\"kops\": %.3f, \"kops_samples\": [",
+                    stats[i].util, stats[i].ops, stats[i].secs,
+                    (stats[i].ops/1e3)/stats[i].secs);
+            for (r = 0; r < stats[i].nsamples; r++)
+                fprintf(fp, "%s%.3f", (r > 0) ? ", " : "",
+                        (stats[i].ops/1e3)/stats[i].samples[r]);
+            fprintf(fp, "]");
+            if (stats[i].has_ci)
+                fprintf(fp, ", \"secs_ci\": [%.9f, %.9f], "
+                        "\"kops_ci\": [%.3f, %.3f]",
+                        stats[i].secs_lo, stats[i].secs_hi,
+                        (stats[i].ops/1e3)/stats[i].secs_hi,
+                        (stats[i].ops/1e3)/stats[i].secs_lo);
+            if (page_stats && stats[i].rss > 0)
+                fprintf(fp, ", \"pages\": %lu",
+                        (unsigned long)stats[i].pages);
+            if (stats[i].rss > 0)
+                fprintf(fp, ", \"rss_kb\": %lu",
+                        (unsigned long)(stats[i].rss / 1024));
+            if (search_stats && stats[i].search > 0)
+                fprintf(fp, ", \"search\": %.2f", stats[i].search);
+            if (stats[i].counted) {
+                fprintf(fp, ", \"counters\": {");
+                for (e = 0; e < PERFCTR_NUM; e++) {
+                    fprintf(fp, "%s\"%s\": ", (e > 0) ? ", " : "",
+                            perfctr_name(e));
+                    if (stats[i].counters.count[e] >= 0)
+                        fprintf(fp, "%lld", stats[i].counters.count[e]);
+                    else
+                        fprintf(fp, "null");
+                }
+                fprintf(fp, "}");
+            }
+            secs += stats[i].secs;
+            ops += stats[i].ops;
+            util += stats[i].util;
+        }
+        fprintf(fp, "}%s\n", (i < n-1) ? "," : "");
+    }
+    fprintf(fp, "    ],\n");
+    if (errors == 0)
+        fprintf(fp, "    \"total\": {\"util\": %.6f, \"ops\": %.0f, "
+                "\"secs\": %.9f, \"kops\": %.3f}\n",
+                util/n, ops, secs, (ops/1e3)/secs);
+    else
+        fprintf(fp, "    \"total\": null\n");
+    fprintf(fp, "  }");
+}
+
+/*
+ * write_json - write the results of the run as JSON, for dashboards and
+ *     as a baseline for --compare
+ */
+static void write_json(char *filename, char **tracefiles, int n,
+                       stats_t *mm_stats, stats_t *libc_stats,
+                       int nalloc, allocator_t **allocs, stats_t **alloc_stats,
+                       double p1, double p2, double perfindex) {
+    FILE *fp;
+    int a;
+
+    if (strcmp(filename, "-") == 0) {
+        fp = stdout;
+    } else if ((fp = fopen(filename, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_json", filename);
+        unix_error(msg);
+    }
+    fprintf(fp, "{\n  \"runs\": %d,\n  \"timer\": \"%s\",\n",
+            num_runs, fsecs_timer_name(fsecs_timer()));
+    if (fsecs_timer() == FSECS_FCYC)
+        fprintf(fp, "  \"cache\": \"%s\",\n", fsecs_cache_name(fsecs_cache()));
+    fprintf(fp, "  \"free_list\": \"%s\",\n", mm_free_list_name(free_list));
+    fprintf(fp, "  \"predict\": %s,\n", predict ? "true" : "false");
+    fprintf(fp, "  \"env\": ");
+    benchenv_json(&env, fp);
+    fprintf(fp, ",\n  \"errors\": %d,\n", errors);
+    fprintf(fp, "  \"mm\": ");
+    json_stats(fp, tracefiles, n, mm_stats);
+    fprintf(fp, ",\n  \"libc\": ");
+    if (libc_stats)
+        json_stats(fp, tracefiles, n, libc_stats);
+    else
+        fprintf(fp, "null");
+    if (nalloc > 0) {
+        fprintf(fp, ",\n  \"allocators\": {");
+        for (a = 0; a < nalloc; a++) {
+            fprintf(fp, "%s\n  ", (a > 0) ? "," : "");
+            json_string(fp, allocs[a]->name);
+            fprintf(fp, ": ");
+            json_stats(fp, tracefiles, n, alloc_stats[a]);
+        }
+        fprintf(fp, "\n  }");
+    }
+    fprintf(fp, ",\n  \"perfindex\": {\"util\": %.3f, \"thru\": %.3f, "
+            "\"total\": %.3f}\n}\n", p1*100, p2*100, perfindex);
+    if (fp != stdout)
+        fclose(fp);
+}
+
+/*
+ * compare_results - compare the mm results with a baseline written by
+ *     --json. A trace regresses if its median throughput drops by more
+ *     than threshold percent and a Mann-Whitney test on the samples
+ *     finds the change significant at level alpha, or if its utilization
+ *     drops by more than util_threshold points. A trace with too few
+ *     samples on either side for the test ever to reach alpha gets no
+ *     throughput verdict ("untested"). Prints a table and returns the
+ *     number of regressions.
+ */
+static int compare_results(char *filename, char **tracefiles, int n,
+                           stats_t *stats) {
+    baseline_t *base;
+    int nbase, i, j, r;
+    int regressions = 0;
+    int slower, faster, tested;
+    double kops[COMPARE_MAXRUNS], base_kops[COMPARE_MAXRUNS];
+    double now, then, change, p;
+    char verdict[MAXLINE];
+
+    if ((nbase = read_baseline(filename, &base)) < 0) {
+        sprintf(msg, "Could not read baseline results from %s", filename);
+        app_error(msg);
+    }
+
+    printf("\nComparison with %s (threshold %.1f%%, util %.1f points, alpha %.2f):\n",
+           filename, threshold, util_threshold, alpha);
+    printf("%5s %-20s%10s%10s%8s%8s%7s%7s  %s\n", "trace", "file",
+           "base Kops", "Kops", "change", "p", "butil", "util", "verdict");
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < nbase; j++)
+            if (strcmp(base[j].file, tracefiles[i]) == 0)
+                break;
+        if (j == nbase || !base[j].valid || base[j].nsamples == 0) {
+            printf("%2d    %-20s%56s\n", i, tracefiles[i], "no baseline");
+            continue;
+        }
+        if (!stats[i].valid) {
+            printf("%2d    %-20s%56s\n", i, tracefiles[i], "INVALID");
+            regressions++;
+            continue;
+        }
+
+        for (r = 0; r < stats[i].nsamples; r++)
+            kops[r] = (stats[i].ops/1e3)/stats[i].samples[r];
+        memcpy(base_kops, base[j].kops, base[j].nsamples * sizeof(double));
+        now = median(kops, stats[i].nsamples);
+        then = median(base_kops, base[j].nsamples);
+        change = (now - then) / then * 100.0;
+        tested = mann_whitney_floor(stats[i].nsamples,
+                                    base[j].nsamples) < alpha;
+        p = mann_whitney(kops, stats[i].nsamples,
+                         base_kops, base[j].nsamples);
+
+        slower = tested && (change < -threshold) && (p < alpha);
+        faster = tested && (change > threshold) && (p < alpha);
+        strcpy(verdict, !tested ? "untested" :
+               (slower ? "SLOWER" : (faster ? "faster" : "ok")));
+        if ((base[j].util - stats[i].util) * 100.0 > util_threshold) {
+            strcpy(verdict, slower ? "SLOWER, UTIL DROP" : "UTIL DROP");
+            slower = 1;
+        }
+        regressions += slower;
+
+        printf("%2d    %-20s%10.0f%10.0f%7.1f%%%8.3f%6.0f%%%6.0f%%  %s\n",
+               i, tracefiles[i], then, now, change, p,
+               base[j].util*100.0, stats[i].util*100.0, verdict);
+    }
+    printf("%d regression%s\n", regressions, (regressions == 1) ? "" : "s");
+    free(base);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -844,18 +2460,87 @@ void malloc_error(int tracenum, int opnum, char *msg) {
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * debug_heap_segv - SIGSEGV handler for -D. Says whether the fault hit
+ *     the guard pages past the end of the heap, then lets the signal
+ *     take its course (the handler is installed with SA_RESETHAND).
+ */
+static void debug_heap_segv(int sig, siginfo_t *info, void *context) {
+    char buf[MAXLINE];
+    int len;
+
+    if (mem_heap_guarded(mem_default_heap(), info->si_addr))
+        len = snprintf(buf, sizeof(buf), "ERROR: access to %p, past the "
+                       "end of the heap at %p (guard page)\n",
+                       info->si_addr, mem_heap_hi());
+    else
+        len = snprintf(buf, sizeof(buf), "ERROR: segmentation fault at %p\n",
+                       info->si_addr);
+    write(STDERR_FILENO, buf, len);
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValD] [-f <file>] [-t <dir>] [-j <n>] [-P <cpus>] [-L] [-O <file>]\n"
+                    "               [-J <file>] [--compare <file>] [--runs <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-D         Debug heap: guard pages past brk, poisoned sbrk memory,\n");
+    fprintf(stderr, "\t           and payload checks (same as --debug-heap).\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-J <file>  Write the results to <file> as JSON (- for stdout).\n");
+    fprintf(stderr, "\t-j <n>     Evaluate up to <n> traces concurrently.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-operation latency percentiles.\n");
+    fprintf(stderr, "\t-O <file>  Export per-operation latencies to <file> as CSV (implies -L).\n");
+    fprintf(stderr, "\t-P <cpus>  With -j, time traces in workers pinned to <cpus> (e.g. 2,4-7);\n");
+    fprintf(stderr, "\t           without, pin the driver to the first of them.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t--json <file>            Same as -J.\n");
+    fprintf(stderr, "\t--compare <file>         Flag regressions against JSON results in <file>;\n");
+    fprintf(stderr, "\t                         exit with status 2 if there are any.\n");
+    fprintf(stderr, "\t--runs <n>               Time each trace <n> times (default 1, 5 with --compare\n");
+    fprintf(stderr, "\t                         or --json; too few samples on either side\n");
+    fprintf(stderr, "\t                         leave a trace \"untested\").\n");
+    fprintf(stderr, "\t--threshold <pct>        Throughput change that counts as a regression (default 5).\n");
+    fprintf(stderr, "\t--util-threshold <pts>   Util drop that counts as a regression (default 1).\n");
+    fprintf(stderr, "\t--alpha <p>              Significance level of the comparison (default 0.05).\n");
+    fprintf(stderr, "\t--frag <n>               Profile fragmentation every <n> ops of the util pass.\n");
+    fprintf(stderr, "\t--frag-file <file>       Write the profile to <file> as CSV (default frag.csv).\n");
+    fprintf(stderr, "\t--heap-backend <name>    Get the simulated heap from malloc (default), mmap,\n");
+    fprintf(stderr, "\t                         populate (pre-faulted mmap), or hugepage (THP mmap).\n");
+    fprintf(stderr, "\t--max-heap <size>        Size of the simulated heap, e.g. 4G (default 20M).\n");
+    fprintf(stderr, "\t--pages                  Report heap pages touched and process RSS after the\n");
+    fprintf(stderr, "\t                         util pass (uses the mmap backend unless another\n");
+    fprintf(stderr, "\t                         mmap-based one is given).\n");
+    fprintf(stderr, "\t--search                 Report how many blocks mm.c looks at per search\n");
+    fprintf(stderr, "\t                         in the util pass.\n");
+    fprintf(stderr, "\t--free-list <policy>     Keep mm.c's free blocks in address order (address,\n");
+    fprintf(stderr, "\t                         the default), also searched through a dense size\n");
+    fprintf(stderr, "\t                         array (dense), in a lifo list, or find them by\n");
+    fprintf(stderr, "\t                         walking the whole heap (implicit).\n");
+    fprintf(stderr, "\t--predict                Have mm.c guess which blocks are short-lived from\n");
+    fprintf(stderr, "\t                         their size and place them high in the heap.\n");
+    fprintf(stderr, "\t--timer <name>           Time traces with tsc (default; invariant TSC, else\n");
+    fprintf(stderr, "\t                         monotonic), monotonic (CLOCK_MONOTONIC_RAW),\n");
+    fprintf(stderr, "\t                         itimer, gettod, or fcyc.\n");
+    fprintf(stderr, "\t--samples <n>            Time with fcyc's robust sampler: the median of <n>\n");
+    fprintf(stderr, "\t                         samples, outliers dropped, with a 95%% interval.\n");
+    fprintf(stderr, "\t--cache <mode>           Time with the cycle counter, first making the caches\n");
+    fprintf(stderr, "\t                         cold (default), warm (an untimed pre-run), tlb-cold,\n");
+    fprintf(stderr, "\t                         or asis (untouched).\n");
+    fprintf(stderr, "\t--cpu <n>                Pin the driver to CPU <n>.\n");
+    fprintf(stderr, "\t--fifo                   Run under SCHED_FIFO (needs root or CAP_SYS_NICE).\n");
+    fprintf(stderr, "\t--alloc <name|lib.so>    Also replay the traces against another allocator: libc,\n");
+    fprintf(stderr, "\t                         or a malloc library to dlopen (e.g. jemalloc, or a\n");
+    fprintf(stderr, "\t                         path). Repeat to compare several side by side.\n");
+    fprintf(stderr, "\t--counters               Report IPC and cache, branch, and dTLB misses per op\n");
+    fprintf(stderr, "\t                         from the hardware performance counters, if any,\n");
+    fprintf(stderr, "\t                         over one more run in the --cache state.\n");
 }
 
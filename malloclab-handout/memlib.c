@@ -1,8 +1,24 @@
 /*
- * memlib.c - a module that simulates the memory system.  Needed because it 
- *            allows us to interleave calls from the student's malloc package 
+ * memlib.c - a module that simulates the memory system.  Needed because it
+ *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
+ *
+ *            Each simulated heap is a mem_heap_t, so a process can run
+ *            several of them side by side (e.g. one per arena). The
+ *            original mem_* functions work on a single default heap,
+ *            set up by mem_init.
+ *
+ *            A heap created with MEM_HEAP_DEBUG catches allocator bugs
+ *            close to where they happen: the pages past brk are
+ *            PROT_NONE, new sbrk memory is poisoned instead of zeroed,
+ *            and a shadow map records which bytes are live payload.
+ *
+ *            On NUMA machines, mem_heap_create_node binds a heap to one
+ *            node, so an allocator can keep a sub-heap per node. Setting
+ *            MEM_FAKE_NUMA=<n> in the environment fakes an n-node
+ *            topology (cpu c on node c % n) for testing on one node.
  */
+#define _GNU_SOURCE    /* for sched_getcpu() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,79 +26,610 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Transparent hugepages are 2 MB on the platforms we care about */
+#define HUGEPAGE_SIZE (2*(1<<20))
+
+/* Shadow map states for each heap byte (MEM_HEAP_DEBUG) */
+#define SHADOW_FREE  0   /* not part of a live payload */
+#define SHADOW_START 1   /* first byte of a live payload */
+#define SHADOW_BODY  2   /* any other byte of a live payload */
+
+/* NUMA memory policy bits, from <numaif.h> (which needs libnuma) */
+#define MPOL_BIND    2
+#define MPOL_F_NODE  (1<<0)
+#define MPOL_F_ADDR  (1<<1)
+#define MPOL_MF_MOVE (1<<1)
+#define MAX_NUMNODES 1024
+
+/* Round p up to a multiple of the page size */
+#define PAGE_ROUNDUP(p) \
+  ((char *)(((size_t)(p) + mem_pagesize() - 1) & ~(mem_pagesize() - 1)))
+
+/* One simulated heap */
+struct mem_heap {
+  mem_backend_t backend; /* where the storage came from */
+  char *map_start;       /* start of the mmap'd region, if any... */
+  size_t map_len;        /* ... and its length */
+  char *start_brk;       /* points to first byte of heap */
+  char *brk;             /* points to last byte of heap */
+  char *max_addr;        /* largest legal heap address */
+  char *dirty_brk;       /* highest brk before the last reset (bytes
+                            below it may have been written) */
+  int flags;             /* MEM_HEAP_xxx flags it was created with */
+  char *guard;           /* MEM_HEAP_DEBUG: start of the PROT_NONE pages */
+  unsigned char *shadow; /* MEM_HEAP_DEBUG: one SHADOW_xxx per heap byte */
+  int node;              /* NUMA node it is bound to, or -1 */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */
+static mem_backend_t mem_backend = MEM_BACKEND_MALLOC; /* see mem_configure */
+static size_t mem_max_heap = MAX_HEAP; /* size of the simulated VM */
+static int mem_flags = 0;              /* MEM_HEAP_xxx flags for mem_init */
+static mem_heap_t *mem_heap = NULL;    /* the default heap (mem_init) */
+static int mem_fake_nodes = -1;        /* MEM_FAKE_NUMA, 0 if unset (-1:
+                                          not looked up yet) */
 
-/* 
- * mem_init - initialize the memory system model
+static int mem_map(mem_heap_t *heap, size_t size);
+
+/* Backend names, indexed by mem_backend_t */
+static const char *mem_backend_names[] = {
+  "malloc", "mmap", "populate", "hugepage"
+};
+
+/*
+ * mem_configure - choose where mem_init gets the simulated VM from, how
+ *    big it is, and its MEM_HEAP_xxx flags. Takes effect at the next
+ *    mem_init.
  */
-void mem_init(void) {
+void mem_configure(mem_backend_t backend, size_t max_heap, int flags) {
+  mem_backend = backend;
+  mem_max_heap = max_heap;
+  mem_flags = flags;
+}
+
+/*
+ * mem_parse_backend - look up a backend by name. Returns 0 if OK, -1 if
+ *    there is no such backend.
+ */
+int mem_parse_backend(const char *name, mem_backend_t *backend) {
+  int i;
+
+  for (i = 0; i < sizeof(mem_backend_names) / sizeof(char *); i++) {
+    if (strcmp(name, mem_backend_names[i]) == 0) {
+      *backend = (mem_backend_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * mem_backend_name - return the name of a backend
+ */
+const char *mem_backend_name(mem_backend_t backend) {
+  return mem_backend_names[backend];
+}
+
+/*
+ * mem_max_heapsize - return the size of the simulated VM in bytes
+ */
+size_t mem_max_heapsize(void) {
+  return mem_max_heap;
+}
+
+/*
+ * mem_heap_create - make a new, empty simulated heap of up to max_heap
+ *    bytes. Returns NULL (with errno set) if the storage can't be had.
+ *    Debug heaps need page-aligned storage to put guard pages in, so
+ *    MEM_HEAP_DEBUG turns MEM_BACKEND_MALLOC into MEM_BACKEND_MMAP.
+ */
+mem_heap_t *mem_heap_create(mem_backend_t backend, size_t max_heap,
+                            int flags) {
+  mem_heap_t *heap;
+
+  if ((heap = (mem_heap_t *)calloc(1, sizeof(mem_heap_t))) == NULL)
+    return NULL;
+  if ((flags & MEM_HEAP_DEBUG) && backend == MEM_BACKEND_MALLOC)
+    backend = MEM_BACKEND_MMAP;
+  heap->backend = backend;
+  heap->flags = flags;
+  heap->node = -1;
+
   /* allocate the storage we will use to model the available VM */
-  if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-    fprintf(stderr, "mem_init_vm: malloc error\n");
-    exit(1);
+  if (backend == MEM_BACKEND_MALLOC) {
+    if ((heap->start_brk = (char *)calloc(1, max_heap)) == NULL) {
+      free(heap);
+      return NULL;
+    }
+  }
+  else if (mem_map(heap, max_heap) < 0) {
+    free(heap);
+    return NULL;
   }
 
-  mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-  mem_brk = mem_start_brk;                  /* heap is empty initially */
+  heap->max_addr = heap->start_brk + max_heap;  /* max legal heap address */
+  heap->brk = heap->start_brk;                  /* heap is empty initially */
+  heap->dirty_brk = heap->start_brk;            /* ... and all zeroes */
+
+  if (flags & MEM_HEAP_DEBUG) {
+    heap->shadow = mmap(NULL, max_heap, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    heap->guard = heap->start_brk;
+    if (heap->shadow == MAP_FAILED ||
+        mprotect(heap->guard, heap->max_addr - heap->guard, PROT_NONE) < 0) {
+      if (heap->shadow != MAP_FAILED)
+        munmap(heap->shadow, max_heap);
+      munmap(heap->map_start, heap->map_len);
+      free(heap);
+      return NULL;
+    }
+  }
+  return heap;
 }
 
-/* 
- * mem_deinit - free the storage used by the memory system model
+/*
+ * mem_heap_create_node - like mem_heap_create, but bind the heap's
+ *    memory to NUMA node with mbind. If that isn't possible (a fake
+ *    topology, or a kernel without NUMA support), the heap is placed by
+ *    first touch instead, so it should be filled by threads running on
+ *    node. The heap must be page aligned, so MEM_BACKEND_MALLOC turns
+ *    into MEM_BACKEND_MMAP here.
  */
-void mem_deinit(void) {
-  free(mem_start_brk);
+mem_heap_t *mem_heap_create_node(mem_backend_t backend, size_t max_heap,
+                                 int flags, int node) {
+  unsigned long mask[MAX_NUMNODES / (8 * sizeof(unsigned long))];
+  mem_heap_t *heap;
+
+  if (backend == MEM_BACKEND_MALLOC)
+    backend = MEM_BACKEND_MMAP;
+  if ((heap = mem_heap_create(backend, max_heap, flags)) == NULL)
+    return NULL;
+  heap->node = node;
+
+  if (!mem_numa_fake() && node >= 0 && node < MAX_NUMNODES) {
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+      1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, heap->start_brk, max_heap, MPOL_BIND,
+            mask, MAX_NUMNODES, MPOL_MF_MOVE);  /* else first touch */
+  }
+  return heap;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_heap_destroy - free the storage used by a simulated heap
  */
-void mem_reset_brk() {
-  mem_brk = mem_start_brk;
+void mem_heap_destroy(mem_heap_t *heap) {
+  if (heap->flags & MEM_HEAP_DEBUG)
+    munmap(heap->shadow, heap->max_addr - heap->start_brk);
+  if (heap->backend == MEM_BACKEND_MALLOC)
+    free(heap->start_brk);
+  else
+    munmap(heap->map_start, heap->map_len);
+  free(heap);
+}
+
+/*
+ * mem_map - get size bytes of zeroed VM for the mmap-based backends.
+ *    MEM_BACKEND_MMAP only reserves address space, so pages are faulted
+ *    in as the heap first touches them. MEM_BACKEND_POPULATE faults
+ *    everything in up front so that no page faults land in the timed
+ *    runs. MEM_BACKEND_HUGEPAGE aligns the heap to a hugepage boundary
+ *    and asks for transparent hugepages to cut down on TLB misses.
+ */
+static int mem_map(mem_heap_t *heap, size_t size) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  char *start;
+
+  heap->map_len = size;
+  if (heap->backend == MEM_BACKEND_POPULATE)
+    flags |= MAP_POPULATE;
+  else
+    flags |= MAP_NORESERVE;
+  if (heap->backend == MEM_BACKEND_HUGEPAGE)
+    heap->map_len += HUGEPAGE_SIZE;  /* slack for aligning the start */
+
+  heap->map_start = mmap(NULL, heap->map_len, PROT_READ | PROT_WRITE,
+                         flags, -1, 0);
+  if (heap->map_start == MAP_FAILED)
+    return -1;
+  start = heap->map_start;
+
+  if (heap->backend == MEM_BACKEND_HUGEPAGE) {
+    start = (char *)(((size_t)start + HUGEPAGE_SIZE - 1) &
+                     ~((size_t)HUGEPAGE_SIZE - 1));
+#ifdef MADV_HUGEPAGE
+    if (madvise(start, size, MADV_HUGEPAGE) < 0)
+      fprintf(stderr, "mem_init_vm: madvise(MADV_HUGEPAGE) failed: %s "
+              "(using normal pages)\n", strerror(errno));
+#else
+    fprintf(stderr, "mem_init_vm: no MADV_HUGEPAGE here (using normal pages)\n");
+#endif
+  }
+  heap->start_brk = start;
+  return 0;
+}
+
+/*
+ * mem_heap_reset_brk - reset the simulated brk pointer to make an
+ *    empty heap. A debug heap also guards all of its pages again and
+ *    forgets every payload in its shadow map.
+ */
+void mem_heap_reset_brk(mem_heap_t *heap) {
+  if (heap->brk > heap->dirty_brk)
+    heap->dirty_brk = heap->brk;
+  heap->brk = heap->start_brk;
+
+  if (heap->flags & MEM_HEAP_DEBUG) {
+    if (heap->guard > heap->start_brk) {
+      mprotect(heap->start_brk, heap->guard - heap->start_brk, PROT_NONE);
+      madvise(heap->shadow, heap->guard - heap->start_brk, MADV_DONTNEED);
+      heap->guard = heap->start_brk;
+    }
+  }
 }
 
-/* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
+/*
+ * mem_heap_sbrk - simple model of the sbrk function. Extends the heap
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap cannot be shrunk. The new area is not
+ *    cleared: it holds whatever was left there before the last
+ *    mem_heap_reset_brk (see mem_heap_fresh).
  */
-void *mem_sbrk(size_t incr) {
-  char *old_brk = mem_brk;
+void *mem_heap_sbrk(mem_heap_t *heap, size_t incr) {
+  char *old_brk = heap->brk;
 
-  if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ) {
+  if ( (incr < 0) || (incr > (size_t)(heap->max_addr - heap->brk)) ) {
     errno = ENOMEM;
     fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
     return (void *)-1;
   }
-  mem_brk += incr;
+  heap->brk += incr;
+
+  /* On a debug heap, unguard the new area and fill it with poison */
+  if (heap->flags & MEM_HEAP_DEBUG) {
+    if (heap->brk > heap->guard) {
+      if (mprotect(heap->guard, PAGE_ROUNDUP(heap->brk) - heap->guard,
+                   PROT_READ | PROT_WRITE) < 0) {
+        perror("ERROR: mem_sbrk failed to move the guard pages");
+        heap->brk = old_brk;
+        return (void *)-1;
+      }
+      heap->guard = PAGE_ROUNDUP(heap->brk);
+    }
+    memset(old_brk, MEM_POISON_BYTE, incr);
+  }
   return (void *)old_brk;
 }
 
+/*
+ * mem_heap_fresh - is [p, p+n), which the caller got from mem_heap_sbrk
+ *    and has not written to, known to read as zero? True if it lies above
+ *    everything the heap handed out before its last reset, except on
+ *    debug heaps, which poison new memory.
+ */
+int mem_heap_fresh(mem_heap_t *heap, void *p, size_t n) {
+  if (heap->flags & MEM_HEAP_DEBUG)
+    return 0;
+  return (char *)p >= heap->dirty_brk && (char *)p + n <= heap->brk;
+}
+
+/*
+ * mem_heap_shadow_mark - record [lo, lo+size) as a live payload in the
+ *    shadow map of a debug heap. Leaving the map as it was, returns
+ *    MEM_SHADOW_OUTSIDE if the range leaves the heap, or
+ *    MEM_SHADOW_OVERLAP if any byte of it is already live.
+ *    Returns 0 if OK (or if the heap has no shadow map).
+ */
+int mem_heap_shadow_mark(mem_heap_t *heap, void *lo, size_t size) {
+  unsigned char *s;
+  size_t i;
+
+  if (!(heap->flags & MEM_HEAP_DEBUG))
+    return 0;
+  if ((char *)lo < heap->start_brk || (char *)lo >= heap->brk ||
+      size == 0 || size > (size_t)(heap->brk - (char *)lo))
+    return MEM_SHADOW_OUTSIDE;
+
+  s = heap->shadow + ((char *)lo - heap->start_brk);
+  for (i = 0; i < size; i++)
+    if (s[i] != SHADOW_FREE)
+      return MEM_SHADOW_OVERLAP;
+  s[0] = SHADOW_START;
+  memset(s + 1, SHADOW_BODY, size - 1);
+  return 0;
+}
+
+/*
+ * mem_heap_shadow_unmark - forget the live payload that starts at lo.
+ *    Returns its size, or -1 if no payload starts there (or the heap
+ *    has no shadow map).
+ */
+long mem_heap_shadow_unmark(mem_heap_t *heap, void *lo) {
+  unsigned char *s, *end;
+  long size;
+
+  if (!(heap->flags & MEM_HEAP_DEBUG) ||
+      (char *)lo < heap->start_brk || (char *)lo >= heap->brk)
+    return -1;
+
+  s = heap->shadow + ((char *)lo - heap->start_brk);
+  end = heap->shadow + (heap->brk - heap->start_brk);
+  if (*s != SHADOW_START)
+    return -1;
+  for (size = 1; s + size < end && s[size] == SHADOW_BODY; size++)
+    ;
+  memset(s, SHADOW_FREE, size);
+  return size;
+}
+
+/*
+ * mem_heap_guarded - is addr in the PROT_NONE pages of a debug heap?
+ */
+int mem_heap_guarded(mem_heap_t *heap, void *addr) {
+  return (heap->flags & MEM_HEAP_DEBUG) &&
+    (char *)addr >= heap->guard && (char *)addr < heap->max_addr;
+}
+
+/*
+ * mem_heap_node - return the NUMA node a heap was created for, or -1
+ */
+int mem_heap_node(mem_heap_t *heap) {
+  return heap->node;
+}
+
+/*
+ * mem_heap_contains - is addr inside the heap, i.e. below brk?
+ */
+int mem_heap_contains(mem_heap_t *heap, void *addr) {
+  return (char *)addr >= heap->start_brk && (char *)addr < heap->brk;
+}
+
+/*
+ * mem_heap_start - return address of the first heap byte
+ */
+void *mem_heap_start(mem_heap_t *heap) {
+  return (void *)heap->start_brk;
+}
+
+/*
+ * mem_heap_end - return address of last heap byte
+ */
+void *mem_heap_end(mem_heap_t *heap) {
+  return (void *)(heap->brk - 1);
+}
+
+/*
+ * mem_heap_size - returns the heap size in bytes
+ */
+size_t mem_heap_size(mem_heap_t *heap) {
+  return (size_t)(heap->brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_max_size - returns the largest the heap can grow, in bytes
+ */
+size_t mem_heap_max_size(mem_heap_t *heap) {
+  return (size_t)(heap->max_addr - heap->start_brk);
+}
+
+/*
+ * mem_heap_touched - return the number of pages between the start of
+ *    the heap and brk that are resident in memory, as seen by mincore.
+ *    Unlike mem_heap_size, this only counts memory the allocator has
+ *    actually touched. Returns 0 if mincore fails.
+ */
+size_t mem_heap_touched(mem_heap_t *heap) {
+  size_t pagesize = mem_pagesize();
+  char *lo = (char *)((size_t)heap->start_brk & ~(pagesize - 1));
+  size_t npages = (heap->brk - lo + pagesize - 1) / pagesize;
+  unsigned char *vec;
+  size_t i, touched = 0;
+
+  if (npages == 0)
+    return 0;
+  if ((vec = (unsigned char *)malloc(npages)) == NULL)
+    return 0;
+  if (mincore(lo, npages * pagesize, vec) == 0) {
+    for (i = 0; i < npages; i++)
+      touched += vec[i] & 1;
+  }
+  free(vec);
+  return touched;
+}
+
+/*
+ * mem_heap_discard - empty the heap and give all of its pages back to
+ *    the kernel, so that mem_heap_touched starts again from zero. Only
+ *    the mmap backends can do this; returns -1 for MEM_BACKEND_MALLOC
+ *    (whose heap is just reset).
+ */
+int mem_heap_discard(mem_heap_t *heap) {
+  mem_heap_reset_brk(heap);
+  if (heap->backend == MEM_BACKEND_MALLOC)
+    return -1;
+
+  /* The discarded pages read back as zeroes, so nothing is dirty now */
+  if (madvise(heap->map_start, heap->map_len, MADV_DONTNEED) < 0)
+    return -1;
+  heap->dirty_brk = heap->start_brk;
+  return 0;
+}
+
+/*
+ * mem_rss - return the resident set size of the whole process in bytes,
+ *    or 0 if it can't be read from /proc
+ */
+size_t mem_rss(void) {
+  FILE *fp;
+  unsigned long size, resident;
+
+  if ((fp = fopen("/proc/self/statm", "r")) == NULL)
+    return 0;
+  if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose(fp);
+  return (size_t)resident * mem_pagesize();
+}
+
+/*
+ * mem_numa_fake - return the number of nodes in the fake topology set
+ *    by MEM_FAKE_NUMA, or 0 if the real topology is in use
+ */
+int mem_numa_fake(void) {
+  char *s;
+
+  if (mem_fake_nodes < 0) {
+    s = getenv("MEM_FAKE_NUMA");
+    mem_fake_nodes = (s != NULL && atoi(s) > 0) ? atoi(s) : 0;
+  }
+  return mem_fake_nodes;
+}
+
+/*
+ * mem_numa_nodes - return the number of NUMA nodes (at least 1)
+ */
+int mem_numa_nodes(void) {
+  DIR *dir;
+  struct dirent *d;
+  int n = 0;
+
+  if (mem_numa_fake())
+    return mem_numa_fake();
+  if ((dir = opendir("/sys/devices/system/node")) == NULL)
+    return 1;
+  while ((d = readdir(dir)) != NULL) {
+    if (strncmp(d->d_name, "node", 4) == 0 && isdigit(d->d_name[4]))
+      n++;
+  }
+  closedir(dir);
+  return (n > 0) ? n : 1;
+}
+
+/*
+ * mem_numa_node_of_cpu - return the NUMA node that cpu belongs to
+ */
+int mem_numa_node_of_cpu(int cpu) {
+  char path[64];
+  int node, nodes = mem_numa_nodes();
+
+  if (mem_numa_fake())
+    return cpu % nodes;
+  for (node = 0; node < nodes; node++) {
+    sprintf(path, "/sys/devices/system/node/node%d/cpu%d", node, cpu);
+    if (access(path, F_OK) == 0)
+      return node;
+  }
+  return 0;
+}
+
+/*
+ * mem_numa_current_node - return the NUMA node of the calling thread's
+ *    current CPU
+ */
+int mem_numa_current_node(void) {
+  int cpu = sched_getcpu();
+
+  return (cpu < 0) ? 0 : mem_numa_node_of_cpu(cpu);
+}
+
+/*
+ * mem_addr_node - return the NUMA node holding the page at addr (which
+ *    must have been touched), or -1 if the kernel can't say or the
+ *    topology is fake
+ */
+int mem_addr_node(void *addr) {
+  int node = -1;
+
+  if (mem_numa_fake())
+    return -1;
+  if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr,
+              MPOL_F_NODE | MPOL_F_ADDR) < 0)
+    return -1;
+  return node;
+}
+
+/*********************************************************
+ * The original single-heap interface. These all work on
+ * the default heap that mem_init creates.
+ ********************************************************/
+
+/*
+ * mem_default_heap - return the heap that mem_init set up
+ */
+mem_heap_t *mem_default_heap(void) {
+  return mem_heap;
+}
+
+/*
+ * mem_init - initialize the memory system model
+ */
+void mem_init(void) {
+  if ((mem_heap = mem_heap_create(mem_backend, mem_max_heap,
+                                  mem_flags)) == NULL) {
+    fprintf(stderr, "mem_init_vm: %s error: %s\n",
+            mem_backend_name(mem_backend), strerror(errno));
+    exit(1);
+  }
+}
+
+/*
+ * mem_deinit - free the storage used by the memory system model
+ */
+void mem_deinit(void) {
+  mem_heap_destroy(mem_heap);
+  mem_heap = NULL;
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ */
+void mem_reset_brk() {
+  mem_heap_reset_brk(mem_heap);
+}
+
+/*
+ * mem_sbrk - extend the default heap by incr bytes (see mem_heap_sbrk)
+ */
+void *mem_sbrk(size_t incr) {
+  return mem_heap_sbrk(mem_heap, incr);
+}
+
+/*
+ * mem_fresh - is [p, p+n) in the default heap known to read as zero?
+ *    (see mem_heap_fresh)
+ */
+int mem_fresh(void *p, size_t n) {
+  return mem_heap_fresh(mem_heap, p, n);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo() {
-  return (void *)mem_start_brk;
+  return mem_heap_start(mem_heap);
 }
 
-/* 
+/*
  * mem_heap_hi - return address of last heap byte
  */
 void *mem_heap_hi() {
-  return (void *)(mem_brk - 1);
+  return mem_heap_end(mem_heap);
 }
 
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() {
-  return (size_t)(mem_brk - mem_start_brk);
+  return mem_heap_size(mem_heap);
 }
 
 /*
@@ -91,4 +638,3 @@ size_t mem_heapsize() {
 size_t mem_pagesize() {
   return (size_t)getpagesize();
 }
-
@@ -1,11 +1,65 @@
 #include <unistd.h>
 
+/* Where a simulated heap gets its storage */
+typedef enum {
+  MEM_BACKEND_MALLOC,    /* libc calloc (the default) */
+  MEM_BACKEND_MMAP,      /* anonymous mmap with MAP_NORESERVE */
+  MEM_BACKEND_POPULATE,  /* anonymous mmap, pre-faulted with MAP_POPULATE */
+  MEM_BACKEND_HUGEPAGE   /* anonymous mmap with madvise(MADV_HUGEPAGE) */
+} mem_backend_t;
+
+/* A simulated heap; the default one is set up by mem_init */
+typedef struct mem_heap mem_heap_t;
+
+/* Flags for mem_heap_create */
+#define MEM_HEAP_DEBUG 0x1  /* guard pages, poisoning, and a shadow map */
+
+/* Debug heaps fill new sbrk memory with this byte instead of zero */
+#define MEM_POISON_BYTE 0xa5
+
+/* Why mem_heap_shadow_mark refused a range */
+#define MEM_SHADOW_OUTSIDE -1  /* the range leaves the heap */
+#define MEM_SHADOW_OVERLAP -2  /* some byte of it is already live */
+
+void mem_configure(mem_backend_t backend, size_t max_heap, int flags);
+int mem_parse_backend(const char *name, mem_backend_t *backend);
+const char *mem_backend_name(mem_backend_t backend);
+size_t mem_max_heapsize(void);
+
+mem_heap_t *mem_heap_create(mem_backend_t backend, size_t max_heap,
+                            int flags);
+mem_heap_t *mem_heap_create_node(mem_backend_t backend, size_t max_heap,
+                                 int flags, int node);
+void mem_heap_destroy(mem_heap_t *heap);
+void *mem_heap_sbrk(mem_heap_t *heap, size_t incr);
+void mem_heap_reset_brk(mem_heap_t *heap);
+void *mem_heap_start(mem_heap_t *heap);
+void *mem_heap_end(mem_heap_t *heap);
+size_t mem_heap_size(mem_heap_t *heap);
+size_t mem_heap_max_size(mem_heap_t *heap);
+int mem_heap_node(mem_heap_t *heap);
+int mem_heap_contains(mem_heap_t *heap, void *addr);
+size_t mem_heap_touched(mem_heap_t *heap);
+int mem_heap_discard(mem_heap_t *heap);
+size_t mem_rss(void);
+int mem_heap_fresh(mem_heap_t *heap, void *p, size_t n);
+int mem_heap_shadow_mark(mem_heap_t *heap, void *lo, size_t size);
+long mem_heap_shadow_unmark(mem_heap_t *heap, void *lo);
+int mem_heap_guarded(mem_heap_t *heap, void *addr);
+
+int mem_numa_fake(void);
+int mem_numa_nodes(void);
+int mem_numa_node_of_cpu(int cpu);
+int mem_numa_current_node(void);
+int mem_addr_node(void *addr);
+
+mem_heap_t *mem_default_heap(void);
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(size_t incr);
+int mem_fresh(void *p, size_t n);
 void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
-
@@ -2,6 +2,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "memlib.h"
 #include "mm.h"
@@ -74,11 +80,154 @@ typedef struct _Block {
   FreeBlockInfo freeNode;
 } Block;
 
-/* Pointer to the first FreeBlockInfo in the free list, the list's head. */
-static Block* free_list_head = NULL;
-static Block* malloc_list_tail = NULL;
+/* Request sizes seen lately, which split_block uses to decide whether
+ * the rest of a block is worth keeping as a free block of its own.
+ * Bucket b counts the requests of more than 2^(b-1) and at most 2^b
+ * bytes. Every SIZE_DECAY_PERIOD requests all the counts are halved, so
+ * old requests fade out as the trace moves on to other sizes.
+ */
+#define SIZE_BUCKETS 48
+#define SIZE_DECAY_PERIOD 512
+#define SIZE_WEIGHT 1024    // what one request adds to its bucket
+
+typedef struct _SizeHistogram {
+  unsigned long count[SIZE_BUCKETS];
+  unsigned long total;       // sum of the counts
+  unsigned long requests;    // requests since the last decay
+} SizeHistogram;
+
+/* Only split off a free block if at least 1/SPLIT_MIN_SHARE of recent
+ * requests would fit in it; otherwise the caller gets the whole block.
+ * Until SPLIT_WARMUP requests have been seen, always split. */
+#define SPLIT_MIN_SHARE 256
+#define SPLIT_WARMUP 32
+
+/* Lifetime prediction for mm_malloc_hint's learned mode. Requests are
+ * grouped into classes, one per 16 bytes up to LIFETIME_SMALL and then
+ * one per power of two, and each class counts the blocks allocated and
+ * freed lately (halving both every LIFETIME_DECAY_PERIOD requests). A
+ * class is short-lived if most of its blocks get freed again within
+ * that window, and at least twice as large a share of them as of all
+ * blocks. When every size comes and goes alike, as in random traces,
+ * nothing is set apart, since there is nothing to gain from it.
+ */
+#define LIFETIME_SMALL 1024
+#define LIFETIME_CLASSES (LIFETIME_SMALL / 16 + SIZE_BUCKETS)
+#define LIFETIME_DECAY_PERIOD 1024
+#define LIFETIME_MIN_ALLOCS 8   // fewer than this and we don't guess
+
+typedef struct _LifetimePredictor {
+  unsigned int allocs[LIFETIME_CLASSES];
+  unsigned int frees[LIFETIME_CLASSES];
+  unsigned long total_allocs;  // sums over all classes
+  unsigned long total_frees;
+  unsigned long requests;  // requests since the last decay
+} LifetimePredictor;
+
+/* A hierarchical bitmap over an arena's heap with one bit per ALIGNMENT
+ * bytes, set where a free block starts. The address-ordered free list
+ * uses it to find a block's free predecessor, and so its place in the
+ * list, without walking the list. Level 0 holds the bits themselves, and
+ * bit i of level l+1 is set if word i of level l has any bit set, so a
+ * lookup touches at most two words per level.
+ */
+#define INDEX_MAX_LEVELS 8
+#define INDEX_WORD_BITS 64
+
+typedef struct _FreeIndex {
+  unsigned long* level[INDEX_MAX_LEVELS];
+  size_t words[INDEX_MAX_LEVELS];  // words in each level
+  int levels;
+  size_t span;  // largest heap it can cover, in bytes
+  // One mapping holds all the levels; pages are only touched when used.
+  void* map;
+  size_t map_len;
+} FreeIndex;
+
+/* With the dense policy, the address-ordered free list is mirrored by
+ * two arrays: the size of each free block and the block itself, in the
+ * same order as the list. A search scans sizes, which is contiguous and
+ * can be compared eight at a time with AVX2, instead of chasing nextFree
+ * pointers from one cache line of the heap to the next. The list stays
+ * the source of truth, and check_heap checks the arrays against it.
+ * Like the index, the arrays are sized for the largest the heap can
+ * get (a free block takes at least sizeof(Block)), so they never grow.
+ */
+typedef struct _FreeArray {
+  long* sizes;      // payload size of each free block, in address order
+  Block** blocks;   // the free blocks themselves
+  size_t count;
+  size_t capacity;
+  // One mapping holds both arrays; pages are only touched when used.
+  void* map;
+  size_t map_len;
+} FreeArray;
+
+/* An Arena is one simulated heap along with the lists that keep track
+ * of it. Normally there is just main_arena, on memlib's default heap.
+ * In NUMA mode (see mm_numa_init) there is one arena per node, each on
+ * a sub-heap bound to that node, and every thread allocates from the
+ * arena of its own node.
+ */
+typedef struct _Arena {
+  // Pointer to the first FreeBlockInfo in the free list, the list's head.
+  Block* free_list_head;
+  Block* malloc_list_tail;
+  size_t heap_size;
+  // The simulated heap the blocks live in.
+  mem_heap_t* heap;
+  // Only taken in NUMA mode, where threads share arenas.
+  pthread_mutex_t lock;
+  // How the free list is kept and searched (see mm_set_free_list).
+  mm_free_list_t policy;
+  // Free block addresses, for the address-ordered policies.
+  FreeIndex index;
+  // Free block sizes, for the dense policy.
+  FreeArray dense;
+  // Recent request sizes, for the split policy.
+  SizeHistogram sizes;
+  // Recent lifetimes by size, for mm_malloc_hint's learned mode.
+  LifetimePredictor lifetimes;
+  // The lifetime class each allocated block was counted in, plus one (0:
+  // not counted), a byte per ALIGNMENT bytes of heap, so that its free
+  // is counted in the same class. Mapped on first use.
+  unsigned char* block_class;
+  size_t block_class_len;
+  // Since mm_init: searches, blocks looked at, and splits we skipped.
+  unsigned long searches;
+  unsigned long search_steps;
+  unsigned long round_ups;
+} Arena;
+
+static Arena main_arena;
+
+/* The arena the calling thread is working on. The top-level mm_*
+ * functions pick it with arena_enter; everything else just uses it. */
+static __thread Arena* arena = &main_arena;
+
+/* NUMA mode: one arena per node, and the arena of this thread's node. */
+static int numa_mode = 0;
+static int numa_arenas = 0;
+static Arena* node_arenas = NULL;
+static __thread Arena* home_arena = NULL;
+
+/* Whether mm_malloc guesses lifetimes (see mm_set_lifetime_prediction). */
+static int predict_lifetimes = 0;
+
+/* Policy new arenas get, set by mm_set_free_list. */
+static mm_free_list_t free_list_policy = MM_FREE_LIST_ADDRESS;
 
-static size_t heap_size = 0;
+/* Names of the policies, indexed by mm_free_list_t. */
+static const char* free_list_names[] = {"implicit", "lifo", "address", "dense"};
+
+/* Whether an arena keeps its free list in address order. */
+#define ADDRESS_ORDERED(a) \
+  ((a)->policy == MM_FREE_LIST_ADDRESS || (a)->policy == MM_FREE_LIST_DENSE)
+
+/* Set by arena_malloc when the block it returned came straight from
+ * mem_sbrk. mm_calloc then asks memlib whether that memory is known to
+ * be zero already (see mem_heap_fresh), and skips clearing it if so. */
+static __thread int last_malloc_fresh = 0;
 
 /* Size of a word on this architecture. */
 #define WORD_SIZE sizeof(void*)
@@ -114,6 +263,59 @@ Block* next_block(Block* block);
  */
 void examine_heap();
 
+/* Merges the free block with its free neighbors, if it has any. */
+void coalesce(Block* blockInfo);
+
+/* Shrinks an allocated block to reqSize bytes of payload, giving the rest
+ * back to the heap as a free block if it is big enough to be one.
+ */
+static void split_block(Block* block, long int reqSize);
+
+/* Add a free block to the arena's free list, or take it off. Where it
+ * goes depends on the arena's policy. */
+static void free_list_insert(Block* block);
+static void free_list_remove(Block* block);
+
+/* Tell the free list that a block on it has changed size. */
+static void free_list_resized(Block* block);
+
+/* Find a free block of at least reqSize bytes by scanning the dense
+ * arrays. Returns NULL if there is none. */
+static Block* searchFreeArray(size_t reqSize);
+
+/* Allocate reqSize bytes from the high end of a free block, leaving the
+ * rest (if it's worth keeping) free at the low end. */
+static Block* carve_high(Block* block, long int reqSize);
+
+/* Records a block of reqSize bytes being allocated or freed, and guesses
+ * whether one being allocated now will be short-lived. */
+static void note_allocated(Block* block, long int reqSize);
+static void note_freed(Block* block);
+static int predict_short_lived(long int reqSize);
+
+/* Set up an arena's free list for its policy, and clear it after the
+ * heap was reset. Returns -1 if the index can't be mapped. */
+static int free_list_init(Arena* a, size_t old_heap_size);
+
+/* Records a request of reqSize bytes in the arena's size histogram. */
+static void note_request_size(long int reqSize);
+
+/* Whether a free block with room for size bytes is likely to be used. */
+static int split_worthwhile(long int size);
+
+/* Allocate and free blocks in the current arena. */
+static void* arena_malloc(size_t size, mm_hint_t hint);
+static void arena_free(void* ptr);
+
+/* Makes a the current arena (taking its lock in NUMA mode) and returns
+ * the arena that was current before, to hand back to arena_leave. */
+static Arena* arena_enter(Arena* a);
+static void arena_leave(Arena* prev);
+
+/* The arena this thread allocates from, and the one that owns ptr. */
+static Arena* local_arena();
+static Arena* owner_arena(void* ptr);
+
 /* Checks the heap for any issues and prints out errors as it finds them.
  *
  * Use this when you are debugging to check for consistency issues. */
@@ -122,9 +324,11 @@ int check_heap();
 Block* searchList(size_t reqSize) {
   Block* ptrFreeBlock = first_block();
   long int checkSize = -reqSize;
+  arena->searches++;
   //code starts here...
   if(ptrFreeBlock != NULL){
     while(ptrFreeBlock != NULL){ //while ptrFreeBlock is NOT null
+      arena->search_steps++;
       if(checkSize >= ptrFreeBlock->info.size) return ptrFreeBlock; //return the block since we have found a fit
     ptrFreeBlock = next_block(ptrFreeBlock); //iterate to next available block
     }
@@ -135,11 +339,16 @@ Block* searchList(size_t reqSize) {
 /* Find a free block of at least the requested size in the free list.  Returns
    NULL if no free block is large enough. */
 Block* searchFreeList(size_t reqSize) {
-  Block* ptrFreeBlock = free_list_head;
+  Block* ptrFreeBlock = arena->free_list_head;
   long int checkSize = -reqSize;
+  arena->searches++;
   
   //code starts here...
-  // When you are ready, you can implement the free list.
+  while(ptrFreeBlock != NULL){ //only free blocks are on the list, so every one is a candidate
+    arena->search_steps++;
+    if(checkSize >= ptrFreeBlock->info.size) return ptrFreeBlock; //first fit in list order
+    ptrFreeBlock = ptrFreeBlock->freeNode.nextFree;
+  }
   return NULL; //return null if we cant find anything
 }
 
@@ -149,46 +358,75 @@ Block* searchFreeList(size_t reqSize) {
  * returns null.
  */
 void* mm_malloc(size_t size) {
+  return mm_malloc_hint(size, MM_HINT_NONE);
+}
+
+/* Same as mm_malloc, but the caller says how long the block will live.
+ * Both kinds go into the first free block that fits, but long-lived
+ * blocks take its low end and short-lived ones its high end. Later
+ * long-lived blocks then pack against the earlier ones, and short-lived
+ * frees leave holes next to each other rather than between long-lived
+ * blocks. With MM_HINT_NONE, the learned mode (if on) guesses, and
+ * otherwise the block is placed as if long-lived. Only the
+ * address-ordered free lists place by lifetime. */
+void* mm_malloc_hint(size_t size, mm_hint_t hint) {
+  Arena* prev = arena_enter(local_arena());
+  void* ptr = arena_malloc(size, hint);
+  arena_leave(prev);
+  return ptr;
+}
+
+static void* arena_malloc(size_t size, mm_hint_t hint) {
   Block* ptrFreeBlock = NULL;
-  Block* splitBlock = NULL;
-  Block* tmpFreeBlock = NULL;
   long int reqSize;
+  int shortLived;
   // Zero-size requests get NULL.
   if (size == 0) {
     return NULL;
   }
   reqSize = size;
   reqSize = ALIGNMENT * ((reqSize + ALIGNMENT - 1) / ALIGNMENT);
+  note_request_size(reqSize);
+  if (hint == MM_HINT_NONE && predict_lifetimes) {
+    hint = predict_short_lived(reqSize) ? MM_HINT_SHORT : MM_HINT_LONG;
+  }
+  shortLived = (hint == MM_HINT_SHORT && ADDRESS_ORDERED(arena));
  
  //code starts here
-  ptrFreeBlock = searchList(reqSize); //checks if there is a single block available in the heap  I.E [-1] [SPOT FOUND] [-1] [-1] [-1]
+  if (arena->policy == MM_FREE_LIST_IMPLICIT) {
+    ptrFreeBlock = searchList(reqSize); //checks if there is a single block available in the heap  I.E [-1] [SPOT FOUND] [-1] [-1] [-1]
+  } else if (arena->policy == MM_FREE_LIST_DENSE) {
+    ptrFreeBlock = searchFreeArray(reqSize); //same, but scanning the sizes of the free blocks
+  } else {
+    ptrFreeBlock = searchFreeList(reqSize); //same, but only looking at the free blocks
+  }
 
     //<<<<<<<<>>> IF WE FOUND A BLOCK <<<<<<<<<>>>
+    if(ptrFreeBlock != NULL && shortLived){ //short-lived blocks take the top of it, long-lived ones the bottom
+      last_malloc_fresh = 0;
+      ptrFreeBlock = carve_high(ptrFreeBlock, reqSize);
+      note_allocated(ptrFreeBlock, reqSize);
+      return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo));
+    }
     if(ptrFreeBlock != NULL){ //if we found a block
         long int positiveSize = -(ptrFreeBlock->info.size); //compute positiveSize which is negation of ptrFreeBlock size (positive value we can use to deduce correct size)
         long int actualBlockSize = positiveSize - reqSize; //calculate the actualBlockSize by subtracting reqSize from positiveSize (which is the negation of ptrFreeBlock->info.size)
-        //if we found a match that can fit the size we simply negate to show its "allocated"
-        if(actualBlockSize <= sizeof(Block)) ptrFreeBlock->info.size*=-1; 
+        //if we found a match that can fit the size we take it off the free list and negate to show its "allocated"
+        free_list_remove(ptrFreeBlock);
+        ptrFreeBlock->info.size*=-1;
         //if actualBlockSize is larger then sizeOfBlock, the block is too large to allocate so we must start splitting
-        if(actualBlockSize > sizeof(Block)){ //if we found a match but the new block is too big (we need to begin splitting)
-          //first lets return the first address that the program can safely write to
-          splitBlock = UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo) + reqSize); //save block pointer to splitBlock which is second part (or right side part) of split block. IE [Splitblock].
-          splitBlock->info.prev = ptrFreeBlock; //this sets splitBlocks previous (which is the 1st part of splitlock, or left part) to be ptrFreeBlock, IE [ptrFreeBlock]][splitBlock]
-          splitBlock->info.size = -(actualBlockSize); //we set splitBlock size to negation of actualBlock size to mark as "allocated"  
-          //make sure when you split a block, it has enough space for all of the metadata: you MUST add the sizeOfBlockInfo to the splitBlockInfo.size because of this to account for metadata
-          splitBlock->info.size += sizeof(BlockInfo); //updating the block info metadata since we split the block (we need to also update the split blocks metadata)
-          ptrFreeBlock->info.size = reqSize; //set size since has content
-          //if the next_block after SplitBlock exists, set that blocks previous to splitBlock
-          tmpFreeBlock = next_block(splitBlock);
-          if(tmpFreeBlock != NULL) tmpFreeBlock->info.prev = splitBlock; //merge next_block(splitBlock) with its previous by setting nextSplitBlock(splitBlock) previous to be splitBlock
-        }
+        if(actualBlockSize > sizeof(Block)) split_block(ptrFreeBlock, reqSize);
+        last_malloc_fresh = 0;
+        note_allocated(ptrFreeBlock, reqSize);
         return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo)); //return addres for a block we found a block that diddnt need space requested 
       }
       //<<<<<<<<>>> IF WE DID NOT FIND A BLOCK <<<<<<<<<>>>
       ptrFreeBlock = requestMoreSpace(reqSize + sizeof(BlockInfo)); //if theres  no space, we need to allocate extra space for the block (this created a new block with metadata) 
-      ptrFreeBlock->info.prev = malloc_list_tail; //adding block to end by makings its prevoius point to current malloc list tail
-      malloc_list_tail = ptrFreeBlock; //updating the malloc_list_tail pointer to point the new tail latest block
+      ptrFreeBlock->info.prev = arena->malloc_list_tail; //adding block to end by makings its prevoius point to current malloc list tail
+      arena->malloc_list_tail = ptrFreeBlock; //updating the malloc_list_tail pointer to point the new tail latest block
       ptrFreeBlock->info.size = reqSize; //updating the size of the allocated block that was just initialized (everytime we make block we need to set the size)
+      last_malloc_fresh = 1; //the payload is brand new heap, so it is still all zeroes
+      note_allocated(ptrFreeBlock, reqSize);
       return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo)); //return addres for a block we found a block that diddnt need space requested 
 }
 
@@ -199,43 +437,783 @@ void coalesce(Block* blockInfo) {
 
  //checking nextBlock for possible coalesce 
   if(nextBlock != NULL && nextBlock->info.size < 0){
+    free_list_remove(nextBlock); //it is part of us now
     blockInfo->info.size += nextBlock->info.size - sizeof(BlockInfo); //must add the difference between nextBlockInfoSize - sizeOf(BlockInfo to blockInfo size to accomodate space
     tmpBlock = next_block(nextBlock); //acquire block to the right of nextBlock (right of the next block - aka next_next block)
     if(tmpBlock != NULL){ //if we are not at Tail  (not coalescing tail)
       tmpBlock->info.prev = blockInfo; //set nextNextBox previous to be blockInfo (merging the two)
-      malloc_list_tail = tmpBlock; //setting the last item as temp tail
-
     }
+    else arena->malloc_list_tail = blockInfo; //we swallowed the tail, so we are the tail now
   }
   //checking previousBlock for possible coalesce
   if(previousBlock != NULL && previousBlock->info.size < 0){
     previousBlock->info.size += blockInfo->info.size - sizeof(BlockInfo); //accounting for metadata
+    free_list_resized(previousBlock);
     tmpBlock = next_block(blockInfo); //acquire block to the right of blockInfo
     if(tmpBlock != NULL){//if not at tail set 
       tmpBlock->info.prev = previousBlock; //grabbing the block to the right and pointing it to the left (merging the two)
-      malloc_list_tail = tmpBlock; //setting last item as temp tail
     }
+    else arena->malloc_list_tail = previousBlock; //we were the tail, so the merged block is the tail now
   }
+  else free_list_insert(blockInfo); //previousBlock is already on the free list, but we are not
 }
 //DONE
 
 /* Free the block referenced by ptr. */
 void mm_free(void* ptr) {
+  Arena* prev = arena_enter(owner_arena(ptr));
+  arena_free(ptr);
+  arena_leave(prev);
+}
+
+static void arena_free(void* ptr) {
   Block* blockInfo = (Block*)UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  if (predict_lifetimes) {
+    note_freed(blockInfo);
+  }
   blockInfo->info.size*=-1;
   coalesce(blockInfo);
 }
 
+/* Shrink an allocated block to reqSize bytes of payload. If what is left
+ * over is big enough to be a block of its own, and recent requests say
+ * something is likely to fit in it, it becomes a free block (merged with
+ * the block after it if that one is free too). Otherwise the block keeps
+ * the slack, which saves a sliver that every search would have to step
+ * over. */
+static void split_block(Block* block, long int reqSize) {
+  long int remainder = block->info.size - reqSize;
+  Block* splitBlock;
+  Block* nextBlock;
+
+  if (remainder <= (long int)sizeof(Block)) {
+    return; // too small to hold a header and the free list pointers
+  }
+  if (!split_worthwhile(remainder - (long int)sizeof(BlockInfo))) {
+    arena->round_ups++;
+    return;
+  }
+  splitBlock = UNSCALED_POINTER_ADD(block, sizeof(BlockInfo) + reqSize);
+  splitBlock->info.size = -(remainder - (long int)sizeof(BlockInfo));
+  splitBlock->info.prev = block;
+  block->info.size = reqSize;
+
+  nextBlock = next_block(splitBlock);
+  if (nextBlock != NULL) {
+    nextBlock->info.prev = splitBlock;
+  } else {
+    arena->malloc_list_tail = splitBlock;
+  }
+  coalesce(splitBlock);
+}
+
+// FREE LISTS ------------------------------------------------------
+
+/* Bit of the free index for block, and the block at a bit. */
+static size_t index_pos(Block* block) {
+  return ((char*)block - (char*)mem_heap_start(arena->heap)) / ALIGNMENT;
+}
+
+static Block* index_block(size_t pos) {
+  return (Block*)UNSCALED_POINTER_ADD(mem_heap_start(arena->heap), pos * ALIGNMENT);
+}
+
+static void index_set(FreeIndex* ix, size_t pos) {
+  unsigned long* word;
+  int l;
+  for (l = 0; l < ix->levels; l++) {
+    word = &ix->level[l][pos / INDEX_WORD_BITS];
+    if (*word != 0) {
+      *word |= 1UL << (pos % INDEX_WORD_BITS);
+      return; // the levels above already know this word is in use
+    }
+    *word = 1UL << (pos % INDEX_WORD_BITS);
+    pos /= INDEX_WORD_BITS;
+  }
+}
+
+static void index_clear(FreeIndex* ix, size_t pos) {
+  unsigned long* word;
+  int l;
+  for (l = 0; l < ix->levels; l++) {
+    word = &ix->level[l][pos / INDEX_WORD_BITS];
+    *word &= ~(1UL << (pos % INDEX_WORD_BITS));
+    if (*word != 0) {
+      return;
+    }
+    pos /= INDEX_WORD_BITS;
+  }
+}
+
+/* Returns the highest set bit below pos, or -1 if there is none. Climbs
+ * until some word has a set bit left of where we came from, then takes
+ * the highest set bit all the way back down. */
+static long index_pred(FreeIndex* ix, size_t pos) {
+  unsigned long bits;
+  int l;
+  for (l = 0; l < ix->levels; l++) {
+    bits = ix->level[l][pos / INDEX_WORD_BITS] &
+      ((1UL << (pos % INDEX_WORD_BITS)) - 1);
+    if (bits != 0) {
+      pos = (pos & ~(size_t)(INDEX_WORD_BITS - 1)) + (INDEX_WORD_BITS - 1) - __builtin_clzl(bits);
+      while (l-- > 0) {
+        pos = pos * INDEX_WORD_BITS + (INDEX_WORD_BITS - 1) - __builtin_clzl(ix->level[l][pos]);
+      }
+      return pos;
+    }
+    pos /= INDEX_WORD_BITS;
+  }
+  return -1;
+}
+
+/* Index of the first entry of d at or after block's address. */
+static size_t dense_find(FreeArray* d, Block* block) {
+  size_t lo = 0, hi = d->count, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (d->blocks[mid] < block) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void dense_insert(FreeArray* d, Block* block) {
+  size_t i = dense_find(d, block);
+
+  assert(d->count < d->capacity);
+  memmove(&d->sizes[i + 1], &d->sizes[i], (d->count - i) * sizeof(long));
+  memmove(&d->blocks[i + 1], &d->blocks[i], (d->count - i) * sizeof(Block*));
+  d->sizes[i] = -block->info.size;
+  d->blocks[i] = block;
+  d->count++;
+}
+
+static void dense_remove(FreeArray* d, Block* block) {
+  size_t i = dense_find(d, block);
+  d->count--;
+  memmove(&d->sizes[i], &d->sizes[i + 1], (d->count - i) * sizeof(long));
+  memmove(&d->blocks[i], &d->blocks[i + 1], (d->count - i) * sizeof(Block*));
+}
+
+/* Index of the first of n sizes that is at least reqSize, or n. */
+static size_t dense_scan_scalar(const long* sizes, size_t n, long reqSize) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (sizes[i] >= reqSize) {
+      break;
+    }
+  }
+  return i;
+}
+
+#if defined(__x86_64__)
+/* Same, eight sizes per iteration. Only called if the CPU has AVX2. */
+__attribute__((target("avx2")))
+static size_t dense_scan_avx2(const long* sizes, size_t n, long reqSize) {
+  __m256i want = _mm256_set1_epi64x(reqSize - 1);
+  __m256i lo, hi;
+  int mask;
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    lo = _mm256_cmpgt_epi64(_mm256_loadu_si256((const __m256i*)&sizes[i]), want);
+    hi = _mm256_cmpgt_epi64(_mm256_loadu_si256((const __m256i*)&sizes[i + 4]), want);
+    mask = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+      (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + dense_scan_scalar(&sizes[i], n - i, reqSize);
+}
+#endif
+
+/* The scan to use, picked on first use. */
+static size_t (*dense_scan)(const long* sizes, size_t n, long reqSize) = NULL;
+
+static Block* searchFreeArray(size_t reqSize) {
+  FreeArray* d = &arena->dense;
+  size_t i;
+
+  if (dense_scan == NULL) {
+    dense_scan = dense_scan_scalar;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+      dense_scan = dense_scan_avx2;
+    }
+#endif
+  }
+  i = dense_scan(d->sizes, d->count, reqSize);
+  arena->searches++;
+  arena->search_steps += (i < d->count) ? i + 1 : i;
+  return (i < d->count) ? d->blocks[i] : NULL;
+}
+
+static Block* carve_high(Block* block, long int reqSize) {
+  long int remainder = -block->info.size - reqSize;
+  Block* carved;
+  Block* nextBlock;
+
+  if (remainder <= (long int)sizeof(Block) ||
+      !split_worthwhile(remainder - (long int)sizeof(BlockInfo))) {
+    if (remainder > (long int)sizeof(Block)) {
+      arena->round_ups++;
+    }
+    free_list_remove(block);
+    block->info.size *= -1;
+    return block;
+  }
+  // The free block stays where it is on the list, only smaller.
+  block->info.size = -(remainder - (long int)sizeof(BlockInfo));
+  free_list_resized(block);
+
+  carved = UNSCALED_POINTER_ADD(block, remainder);
+  carved->info.size = reqSize;
+  carved->info.prev = block;
+  nextBlock = next_block(carved);
+  if (nextBlock != NULL) {
+    nextBlock->info.prev = carved;
+  } else {
+    arena->malloc_list_tail = carved;
+  }
+  return carved;
+}
+
+static void free_list_insert(Block* block) {
+  Block* pred = NULL;
+  long pos;
+
+  if (ADDRESS_ORDERED(arena)) {
+    index_set(&arena->index, index_pos(block));
+    if ((pos = index_pred(&arena->index, index_pos(block))) >= 0) {
+      pred = index_block(pos);
+    }
+  }
+  // LIFO (and implicit, which keeps the list only for check_heap) push
+  // onto the front; address order goes right after the free predecessor.
+  block->freeNode.prevFree = pred;
+  block->freeNode.nextFree = pred ? pred->freeNode.nextFree : arena->free_list_head;
+  if (block->freeNode.nextFree != NULL) {
+    block->freeNode.nextFree->freeNode.prevFree = block;
+  }
+  if (pred != NULL) {
+    pred->freeNode.nextFree = block;
+  } else {
+    arena->free_list_head = block;
+  }
+  if (arena->policy == MM_FREE_LIST_DENSE) {
+    dense_insert(&arena->dense, block);
+  }
+}
+
+static void free_list_remove(Block* block) {
+  Block* prevFree = block->freeNode.prevFree;
+  Block* nextFree = block->freeNode.nextFree;
+
+  if (prevFree != NULL) {
+    prevFree->freeNode.nextFree = nextFree;
+  } else {
+    arena->free_list_head = nextFree;
+  }
+  if (nextFree != NULL) {
+    nextFree->freeNode.prevFree = prevFree;
+  }
+  if (ADDRESS_ORDERED(arena)) {
+    index_clear(&arena->index, index_pos(block));
+  }
+  if (arena->policy == MM_FREE_LIST_DENSE) {
+    dense_remove(&arena->dense, block);
+  }
+}
+
+static void free_list_resized(Block* block) {
+  FreeArray* d = &arena->dense;
+  if (arena->policy == MM_FREE_LIST_DENSE) {
+    d->sizes[dense_find(d, block)] = -block->info.size;
+  }
+}
+
+/* Map the dense arrays, with room for every free block the heap can
+ * hold. Returns -1 if they can't be mapped. */
+static int dense_init(FreeArray* d, mem_heap_t* heap) {
+  size_t capacity = mem_heap_max_size(heap) / sizeof(Block) + 1;
+  size_t len = capacity * (sizeof(long) + sizeof(Block*));
+  void* map;
+
+  map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  d->map = map;
+  d->map_len = len;
+  d->capacity = capacity;
+  d->sizes = map;
+  d->blocks = (Block**)(d->sizes + capacity);
+  return 0;
+}
+
+static int free_list_init(Arena* a, size_t old_heap_size) {
+  FreeIndex* ix = &a->index;
+  size_t bits, used, len = 0;
+  int l;
+
+  a->free_list_head = NULL;
+  a->dense.count = 0;
+  if (!ADDRESS_ORDERED(a)) {
+    return 0;
+  }
+  if (a->policy == MM_FREE_LIST_DENSE && a->dense.map == NULL &&
+      dense_init(&a->dense, a->heap) < 0) {
+    return -1;
+  }
+  if (ix->map != NULL) {
+    // Only the words that covered the old heap can have bits set.
+    used = old_heap_size / ALIGNMENT + 1;
+    for (l = 0; l < ix->levels; l++) {
+      used = (used + INDEX_WORD_BITS - 1) / INDEX_WORD_BITS;
+      memset(ix->level[l], 0, (used < ix->words[l] ? used : ix->words[l]) * sizeof(unsigned long));
+    }
+    return 0;
+  }
+
+  // Size the levels for the largest the heap can ever get.
+  bits = mem_heap_max_size(a->heap) / ALIGNMENT + 1;
+  ix->levels = 0;
+  do {
+    ix->words[ix->levels] = (bits + INDEX_WORD_BITS - 1) / INDEX_WORD_BITS;
+    len += ix->words[ix->levels] * sizeof(unsigned long);
+    bits = ix->words[ix->levels++];
+  } while (bits > 1 && ix->levels < INDEX_MAX_LEVELS);
+
+  ix->map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ix->map == MAP_FAILED) {
+    ix->map = NULL;
+    return -1;
+  }
+  ix->map_len = len;
+  ix->span = mem_heap_max_size(a->heap);
+  ix->level[0] = ix->map;
+  for (l = 1; l < ix->levels; l++) {
+    ix->level[l] = ix->level[l - 1] + ix->words[l - 1];
+  }
+  return 0;
+}
+
+/* Choose how the free list is kept and searched. Takes effect for the
+ * main arena at the next mm_init, and for mm_numa_init's arenas. */
+void mm_set_free_list(mm_free_list_t policy) {
+  free_list_policy = policy;
+}
+
+/* Look up a free-list policy by name. Returns 0 if OK, -1 if there is
+ * no such policy. */
+int mm_parse_free_list(const char* name, mm_free_list_t* policy) {
+  int i;
+  for (i = 0; i < (int)(sizeof(free_list_names) / sizeof(char*)); i++) {
+    if (strcmp(name, free_list_names[i]) == 0) {
+      *policy = (mm_free_list_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char* mm_free_list_name(mm_free_list_t policy) {
+  return free_list_names[policy];
+}
+
+// LIFETIME PREDICTION ---------------------------------------------
+
+/* Turn the learned mode of mm_malloc_hint on or off. */
+void mm_set_lifetime_prediction(int on) {
+  predict_lifetimes = on;
+}
+
+static int lifetime_class(long int size) {
+  int b = 0;
+  if (size <= LIFETIME_SMALL) {
+    return (size - 1) / 16;
+  }
+  while (b < SIZE_BUCKETS - 1 && (1L << b) < size) {
+    b++;
+  }
+  return LIFETIME_SMALL / 16 + b;
+}
+
+/* Where the lifetime class of the block at b is kept, or NULL if the
+ * map can't be had. */
+static unsigned char* block_class_slot(Block* b) {
+  size_t len;
+  void* map;
+
+  if (arena->block_class == NULL) {
+    len = mem_heap_max_size(arena->heap) / ALIGNMENT + 1;
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+      return NULL;
+    }
+    arena->block_class = map;
+    arena->block_class_len = len;
+  }
+  return &arena->block_class[((char*)b - (char*)mem_heap_start(arena->heap)) / ALIGNMENT];
+}
+
+/* Count an allocation of reqSize bytes, which got block, in its class,
+ * and remember the class for when the block is freed. */
+static void note_allocated(Block* block, long int reqSize) {
+  LifetimePredictor* lp = &arena->lifetimes;
+  unsigned char* slot;
+  int c, i;
+
+  if (!predict_lifetimes) {
+    return;
+  }
+  c = lifetime_class(reqSize);
+  if ((slot = block_class_slot(block)) != NULL) {
+    *slot = c + 1;
+  }
+  lp->allocs[c]++;
+  lp->total_allocs++;
+  if (++lp->requests == LIFETIME_DECAY_PERIOD) {
+    lp->total_allocs = lp->total_frees = 0;
+    for (i = 0; i < LIFETIME_CLASSES; i++) {
+      lp->allocs[i] /= 2;
+      lp->frees[i] /= 2;
+      lp->total_allocs += lp->allocs[i];
+      lp->total_frees += lp->frees[i];
+    }
+    lp->requests = 0;
+  }
+}
+
+/* Count the free of block in the class its allocation was counted in.
+ * Blocks that weren't counted (allocated before prediction was turned
+ * on, say) aren't counted now either. */
+static void note_freed(Block* block) {
+  LifetimePredictor* lp = &arena->lifetimes;
+  unsigned char* slot = block_class_slot(block);
+
+  if (slot == NULL || *slot == 0) {
+    return;
+  }
+  lp->frees[*slot - 1]++;
+  lp->total_frees++;
+  *slot = 0;
+}
+
+static int predict_short_lived(long int reqSize) {
+  LifetimePredictor* lp = &arena->lifetimes;
+  int c = lifetime_class(reqSize);
+
+  if (lp->allocs[c] < LIFETIME_MIN_ALLOCS) {
+    return 0;
+  }
+  return 2 * lp->frees[c] >= lp->allocs[c] &&
+    lp->frees[c] * lp->total_allocs >= 2 * lp->total_frees * lp->allocs[c];
+}
+
+// SPLIT POLICY ----------------------------------------------------
+
+static void note_request_size(long int reqSize) {
+  SizeHistogram* h = &arena->sizes;
+  int b = 0, i;
+
+  while (b < SIZE_BUCKETS - 1 && (1L << b) < reqSize) {
+    b++;
+  }
+  h->count[b] += SIZE_WEIGHT;
+  h->total += SIZE_WEIGHT;
+  if (++h->requests == SIZE_DECAY_PERIOD) {
+    h->total = 0;
+    for (i = 0; i < SIZE_BUCKETS; i++) {
+      h->count[i] /= 2;
+      h->total += h->count[i];
+    }
+    h->requests = 0;
+  }
+}
+
+/* Whole buckets count if all their sizes fit, and the bucket that size
+ * falls in counts in proportion to how much of its range fits. */
+static int split_worthwhile(long int size) {
+  SizeHistogram* h = &arena->sizes;
+  unsigned long fits = 0;
+  long int lo;
+  int b;
+
+  if (h->total < (unsigned long)SPLIT_WARMUP * SIZE_WEIGHT) {
+    return 1; // too few requests seen to tell
+  }
+  for (b = 0; b < SIZE_BUCKETS && (1L << b) <= size; b++) {
+    fits += h->count[b];
+  }
+  if (b > 0 && b < SIZE_BUCKETS) {
+    lo = 1L << (b - 1);
+    fits += h->count[b] * (size - lo) / lo;
+  }
+  return fits * SPLIT_MIN_SHARE >= h->total;
+}
+
+/* Resize the block at ptr to hold size bytes. The block is resized in
+ * place when it is shrinking, when the free block after it has room, or
+ * when it is the last block in the heap; otherwise it is moved. */
+void* mm_realloc(void* ptr, size_t size) {
+  Block* block;
+  Block* nextBlock;
+  long int reqSize, oldSize;
+  void* newPtr;
+  Arena* prev;
+
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+  block = (Block*)UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+  prev = arena_enter(owner_arena(ptr));
+
+  // Swallow the free block to our right, if there is one.
+  nextBlock = next_block(block);
+  if (block->info.size < reqSize && nextBlock != NULL && nextBlock->info.size < 0) {
+    free_list_remove(nextBlock);
+    block->info.size += sizeof(BlockInfo) - nextBlock->info.size;
+    nextBlock = next_block(block);
+    if (nextBlock != NULL) {
+      nextBlock->info.prev = block;
+    } else {
+      arena->malloc_list_tail = block;
+    }
+  }
+
+  // The last block in the heap can always grow by extending the heap.
+  if (block->info.size < reqSize && nextBlock == NULL) {
+    requestMoreSpace(reqSize - block->info.size);
+    block->info.size = reqSize;
+  }
+
+  if (block->info.size >= reqSize) {
+    split_block(block, reqSize);
+    arena_leave(prev);
+    return ptr;
+  }
+  oldSize = block->info.size;
+  arena_leave(prev);
+
+  // No room here, so move the payload to a new block (which may come
+  // from another arena, so we must not hold this one's lock).
+  newPtr = mm_malloc(size);
+  if (newPtr == NULL) {
+    return NULL;
+  }
+  memcpy(newPtr, ptr, oldSize);
+  mm_free(ptr);
+  return newPtr;
+}
+
+/* Allocate a zeroed array of nmemb elements of size bytes each. */
+void* mm_calloc(size_t nmemb, size_t size) {
+  size_t bytes;
+  void* ptr;
+  int fresh;
+  Arena* prev;
+
+  if (nmemb != 0 && size > (size_t)-1 / nmemb) {
+    return NULL; // nmemb * size overflows
+  }
+  bytes = nmemb * size;
+  prev = arena_enter(local_arena());
+  ptr = arena_malloc(bytes, MM_HINT_NONE);
+  fresh = ptr != NULL && last_malloc_fresh &&
+    mem_heap_fresh(arena->heap, ptr, bytes);
+  arena_leave(prev);
+  // Only recycled blocks need clearing: heap never handed out before is
+  // already zero (unless memlib is poisoning it to catch this assumption).
+  if (ptr != NULL && !fresh) {
+    memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+/* Returns the payload bytes of the block at ptr (an allocated block's
+ * size, without its header), like malloc_usable_size. */
+size_t mm_usable_size(void* ptr) {
+  Block* block;
+  if (ptr == NULL) {
+    return 0;
+  }
+  block = (Block*)UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  return block->info.size;
+}
+
+/* Allocate size bytes whose address is a multiple of alignment, which
+ * must be a power of two. We over-allocate, carve an aligned block out
+ * of the middle, and give the slack on either side back as free blocks. */
+void* mm_memalign(size_t alignment, size_t size) {
+  Block* block;
+  Block* aligned;
+  Block* nextBlock;
+  long int reqSize, lead;
+  size_t payload;
+  void* ptr;
+  unsigned char* slot;
+  Arena* prev;
+
+  if (size == 0 || (alignment & (alignment - 1)) != 0) {
+    return NULL;
+  }
+  if (alignment <= ALIGNMENT) {
+    return mm_malloc(size);
+  }
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  // Enough for the payload, the worst-case distance to an aligned
+  // address, and a free block in front of it.
+  prev = arena_enter(local_arena());
+  ptr = arena_malloc(reqSize + alignment + sizeof(Block), MM_HINT_NONE);
+  if (ptr == NULL) {
+    arena_leave(prev);
+    return NULL;
+  }
+  block = (Block*)UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  aligned = block;
+
+  if ((size_t)ptr % alignment != 0) {
+    // Leave room for a whole free block (header and list pointers) in front.
+    payload = ((size_t)ptr + sizeof(Block) + alignment - 1) & ~(alignment - 1);
+    aligned = (Block*)(payload - sizeof(BlockInfo));
+    lead = (char*)aligned - (char*)block;
+
+    aligned->info.size = block->info.size - lead;
+    aligned->info.prev = block;
+    nextBlock = next_block(aligned);
+    if (nextBlock != NULL) {
+      nextBlock->info.prev = aligned;
+    } else {
+      arena->malloc_list_tail = aligned;
+    }
+
+    // The lead becomes a block of its own, which we free right away. The
+    // aligned block is the one the allocation was counted for.
+    block->info.size = lead - sizeof(BlockInfo);
+    if (predict_lifetimes && (slot = block_class_slot(block)) != NULL) {
+      *block_class_slot(aligned) = *slot;
+      *slot = 0;
+    }
+    arena_free(ptr);
+  }
+
+  split_block(aligned, reqSize);
+  arena_leave(prev);
+  return UNSCALED_POINTER_ADD(aligned, sizeof(BlockInfo));
+}
+
+// ARENAS ----------------------------------------------------------
+
+static Arena* arena_enter(Arena* a) {
+  Arena* prev = arena;
+  if (numa_mode) {
+    pthread_mutex_lock(&a->lock);
+  }
+  arena = a;
+  return prev;
+}
+
+static void arena_leave(Arena* prev) {
+  if (numa_mode) {
+    pthread_mutex_unlock(&arena->lock);
+  }
+  arena = prev;
+}
+
+static Arena* local_arena() {
+  if (!numa_mode) {
+    return &main_arena;
+  }
+  // Look up our node once; threads are expected to stay on their node.
+  if (home_arena == NULL) {
+    home_arena = &node_arenas[mem_numa_current_node() % numa_arenas];
+  }
+  return home_arena;
+}
+
+static Arena* owner_arena(void* ptr) {
+  int i;
+  if (!numa_mode) {
+    return &main_arena;
+  }
+  for (i = 0; i < numa_arenas; i++) {
+    if (mem_heap_contains(node_arenas[i].heap, ptr)) {
+      return &node_arenas[i];
+    }
+  }
+  return &main_arena;
+}
+
+/* Switch to NUMA mode with one arena per node, each on a sub-heap of up
+ * to heap_bytes bytes bound to its node. Threads allocate from the arena
+ * of the node they run on (or the one given to mm_numa_bind_thread), and
+ * blocks are always freed back to the arena they came from. Returns -1
+ * if the sub-heaps can't be created. */
+int mm_numa_init(int nodes, size_t heap_bytes) {
+  int i;
+
+  if ((node_arenas = calloc(nodes, sizeof(Arena))) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < nodes; i++) {
+    node_arenas[i].heap = mem_heap_create_node(MEM_BACKEND_MMAP, heap_bytes, 0, i);
+    if (node_arenas[i].heap == NULL) {
+      return -1;
+    }
+    pthread_mutex_init(&node_arenas[i].lock, NULL);
+    node_arenas[i].policy = free_list_policy;
+    if (free_list_init(&node_arenas[i], 0) < 0) {
+      return -1;
+    }
+  }
+  numa_arenas = nodes;
+  numa_mode = 1;
+  home_arena = NULL;
+  return 0;
+}
+
+/* Make the calling thread allocate from node's arena from now on, e.g.
+ * when testing with a fake topology. */
+void mm_numa_bind_thread(int node) {
+  home_arena = &node_arenas[node % numa_arenas];
+}
+
+/* Returns the node whose arena ptr came from, or -1 if it isn't from
+ * any of them. */
+int mm_numa_node(void* ptr) {
+  int i;
+  for (i = 0; i < numa_arenas; i++) {
+    if (mem_heap_contains(node_arenas[i].heap, ptr)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 // PROVIDED FUNCTIONS -----------------------------------------------
 // You do not need to modify these, but they might be helpful to read
 // over.
 
 /* Get more heap space of exact size reqSize. */
 void* requestMoreSpace(size_t reqSize) {
-  void* ret = UNSCALED_POINTER_ADD(mem_heap_lo(), heap_size);
-  heap_size += reqSize;
+  void* ret = UNSCALED_POINTER_ADD(mem_heap_start(arena->heap), arena->heap_size);
+  arena->heap_size += reqSize;
 
-  void* mem_sbrk_result = mem_sbrk(reqSize);
+  void* mem_sbrk_result = mem_heap_sbrk(arena->heap, reqSize);
   if ((size_t)mem_sbrk_result == -1) {
     printf("ERROR: mem_sbrk failed in requestMoreSpace\n");
     exit(0);
@@ -246,17 +1224,46 @@ void* requestMoreSpace(size_t reqSize) {
 
 /* Initialize the allocator. */
 int mm_init() {
-  free_list_head = NULL;
-  malloc_list_tail = NULL;
-  heap_size = 0;
+  size_t old_heap_size = main_arena.heap_size;
+
+  arena = &main_arena;
+  if (arena->block_class != NULL) {
+    // Start over with no block counted (and the right size for the heap).
+    munmap(arena->block_class, arena->block_class_len);
+    arena->block_class = NULL;
+  }
+  if (arena->heap != mem_default_heap() || arena->policy != free_list_policy ||
+      arena->index.span != mem_heap_max_size(mem_default_heap())) {
+    // A new heap (or policy) needs a new index and dense arrays.
+    if (arena->index.map != NULL) {
+      munmap(arena->index.map, arena->index.map_len);
+    }
+    memset(&arena->index, 0, sizeof(arena->index));
+    if (arena->dense.map != NULL) {
+      munmap(arena->dense.map, arena->dense.map_len);
+    }
+    memset(&arena->dense, 0, sizeof(arena->dense));
+  }
+  arena->heap = mem_default_heap();
+  arena->policy = free_list_policy;
+  if (free_list_init(arena, old_heap_size) < 0) {
+    return -1;
+  }
+  arena->malloc_list_tail = NULL;
+  arena->heap_size = 0;
+  memset(&arena->sizes, 0, sizeof(arena->sizes));
+  memset(&arena->lifetimes, 0, sizeof(arena->lifetimes));
+  arena->searches = 0;
+  arena->search_steps = 0;
+  arena->round_ups = 0;
 
   return 0;
 }
 
 /* Gets the first block in the heap or returns NULL if there is not one. */
 Block* first_block() {
-  Block* first = (Block*)mem_heap_lo();
-  if (heap_size == 0) {
+  Block* first = (Block*)mem_heap_start(arena->heap);
+  if (arena->heap_size == 0) {
     return NULL;
   }
   return first;
@@ -266,7 +1273,7 @@ Block* first_block() {
 Block* next_block(Block* block) {
   size_t distance = (block->info.size > 0) ? block->info.size : -block->info.size;
 
-  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_lo(), heap_size);
+  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_start(arena->heap), arena->heap_size);
   Block* next = (Block*)UNSCALED_POINTER_ADD(block, sizeof(BlockInfo) + distance);
   if (next >= end) {
     return NULL;
@@ -277,15 +1284,15 @@ Block* next_block(Block* block) {
 /* Print the heap by iterating through it as an implicit free list. */
 void examine_heap() {
   /* print to stderr so output isn't buffered and not output if we crash */
-  Block* curr = (Block*)mem_heap_lo();
-  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_lo(), heap_size);
-  fprintf(stderr, "heap size:\t0x%lx\n", heap_size);
+  Block* curr = (Block*)mem_heap_start(arena->heap);
+  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_start(arena->heap), arena->heap_size);
+  fprintf(stderr, "heap size:\t0x%lx\n", arena->heap_size);
   fprintf(stderr, "heap start:\t%p\n", curr);
   fprintf(stderr, "heap end:\t%p\n", end);
 
-  fprintf(stderr, "free_list_head: %p\n", (void*)free_list_head);
+  fprintf(stderr, "arena->free_list_head: %p\n", (void*)arena->free_list_head);
 
-  fprintf(stderr, "malloc_list_tail: %p\n", (void*)malloc_list_tail);
+  fprintf(stderr, "arena->malloc_list_tail: %p\n", (void*)arena->malloc_list_tail);
 
   while(curr && curr < end) {
     /* print out common block attributes */
@@ -302,7 +1309,7 @@ void examine_heap() {
   }
   fprintf(stderr, "END OF HEAP\n\n");
 
-  curr = free_list_head;
+  curr = arena->free_list_head;
   fprintf(stderr, "Head ");
   while(curr) {
     fprintf(stderr, "-> %p ", curr);
@@ -311,12 +1318,37 @@ void examine_heap() {
   fprintf(stderr, "\n");
 }
 
+/* Fill in stats by walking the heap as an implicit free list. */
+void mm_heapstats(mm_heapstats_t* stats) {
+  Block* curr = first_block();
+  size_t size;
+
+  stats->free_blocks = 0;
+  stats->free_bytes = 0;
+  stats->largest_free = 0;
+  stats->searches = arena->searches;
+  stats->search_steps = arena->search_steps;
+  stats->round_ups = arena->round_ups;
+  while (curr) {
+    if (curr->info.size < 0) {
+      size = -curr->info.size;
+      stats->free_blocks++;
+      stats->free_bytes += size;
+      if (size > stats->largest_free) {
+        stats->largest_free = size;
+      }
+    }
+    curr = next_block(curr);
+  }
+}
+
 /* Checks the heap data structure for consistency. */
 int check_heap() {
-  Block* curr = (Block*)mem_heap_lo();
-  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_lo(), heap_size);
+  Block* curr = (Block*)mem_heap_start(arena->heap);
+  Block* end = (Block*)UNSCALED_POINTER_ADD(mem_heap_start(arena->heap), arena->heap_size);
   Block* last = NULL;
   long int free_count = 0;
+  size_t dense;
 
   while(curr && curr < end) {
     if (curr->info.prev != last) {
@@ -333,13 +1365,29 @@ int check_heap() {
     curr = next_block(curr);
   }
 
-  curr = free_list_head;
+  curr = arena->free_list_head;
   last = NULL;
+  dense = 0;
   while(curr) {
+    if (arena->policy == MM_FREE_LIST_DENSE &&
+        (dense >= arena->dense.count || arena->dense.blocks[dense] != curr ||
+         arena->dense.sizes[dense] != -curr->info.size)) {
+      fprintf(stderr, "check_heap: Error: dense free array does not match the free list.\n");
+      examine_heap();
+    }
+    dense++;
     if (curr == last) {
       fprintf(stderr, "check_heap: Error: free list is circular.\n");
       examine_heap();
     }
+    if (curr->info.size > 0) {
+      fprintf(stderr, "check_heap: Error: allocated block on the free list.\n");
+      examine_heap();
+    }
+    if (ADDRESS_ORDERED(arena) && last != NULL && curr < last) {
+      fprintf(stderr, "check_heap: Error: free list is out of address order.\n");
+      examine_heap();
+    }
     last = curr;
     curr = curr->freeNode.nextFree;
     if (free_count == 0) {
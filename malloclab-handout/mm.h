@@ -3,7 +3,50 @@
 extern int mm_init(void);
 extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
+
+/* How long a block will live, for mm_malloc_hint */
+typedef enum {
+  MM_HINT_NONE,   // don't know (guess, if learned mode is on)
+  MM_HINT_SHORT,  // freed again soon
+  MM_HINT_LONG    // kept around
+} mm_hint_t;
+
+extern void *mm_malloc_hint(size_t size, mm_hint_t hint);
+extern void mm_set_lifetime_prediction(int on);
 extern void examine_heap();
 
+/* A snapshot of the free blocks in the heap, filled in by mm_heapstats */
+typedef struct {
+  size_t free_blocks;   // number of free blocks
+  size_t free_bytes;    // total size of the free blocks
+  size_t largest_free;  // size of the largest free block
+  // Since mm_init:
+  size_t searches;      // searches for a free block
+  size_t search_steps;  // blocks looked at in those searches
+  size_t round_ups;     // splits skipped because the rest was unlikely to be used
+} mm_heapstats_t;
+
+extern void mm_heapstats(mm_heapstats_t* stats);
+
+/* How free blocks are kept and searched; set before mm_init */
+typedef enum {
+  MM_FREE_LIST_IMPLICIT,  // first fit over every block in the heap
+  MM_FREE_LIST_LIFO,      // explicit list, most recently freed first
+  MM_FREE_LIST_ADDRESS,   // explicit list in address order (the default)
+  MM_FREE_LIST_DENSE      // address order, searched through a dense size array
+} mm_free_list_t;
+
+extern void mm_set_free_list(mm_free_list_t policy);
+extern int mm_parse_free_list(const char* name, mm_free_list_t* policy);
+extern const char* mm_free_list_name(mm_free_list_t policy);
+
 // Extra credit
 extern void* mm_realloc(void* ptr, size_t size);
+extern void* mm_calloc(size_t nmemb, size_t size);
+extern void* mm_memalign(size_t alignment, size_t size);
+extern size_t mm_usable_size(void* ptr);
+
+// NUMA mode: one arena per node (see numabench.c)
+extern int mm_numa_init(int nodes, size_t heap_bytes);
+extern void mm_numa_bind_thread(int node);
+extern int mm_numa_node(void* ptr);
@@ -0,0 +1,229 @@
+/*
+ * numabench.c - Multithreaded benchmark for the NUMA mode of mm.c
+ *
+ * Starts one thread per CPU slot, spread round-robin over the NUMA
+ * nodes, and has each thread run a random mix of mm_malloc and mm_free
+ * calls, writing to every block it gets. For every block it reports
+ * whether the block is local, i.e. on the thread's own node.
+ *
+ * Where the kernel can tell (real NUMA), a block's node is the node of
+ * its first page. With a fake topology (MEM_FAKE_NUMA=<n>), it is the
+ * node of the arena the block came from.
+ *
+ * With -1, all threads share a single arena, which shows how much
+ * memory ends up remote without the per-node arenas.
+ */
+#define _GNU_SOURCE    /* for CPU_SET() and sched_setaffinity() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Number of live blocks each thread juggles */
+#define SLOTS 256
+
+/* Per-thread parameters and results */
+typedef struct {
+    pthread_t tid;
+    int id;            /* thread number */
+    int node;          /* node the thread runs on */
+    int cpu;           /* CPU it is pinned to, or -1 */
+    long local;        /* blocks that landed on our node... */
+    long remote;       /* ... and those that didn't */
+    long unknown;      /* blocks whose node couldn't be found */
+} thread_t;
+
+/* Command line parameters */
+static int num_threads = 0;        /* 0: one per CPU */
+static long num_ops = 200000;      /* malloc/free calls per thread */
+static int max_size = 512;         /* largest request in bytes */
+static size_t heap_bytes = 256 << 20; /* size of each node's sub-heap */
+static int single_arena = 0;       /* -1: one arena for all threads */
+
+static void *worker(void *arg);
+static int pick_cpu(int node, int nth);
+static void usage(void);
+
+int main(int argc, char **argv) {
+    int c, i, nodes, ncpus;
+    thread_t *threads;
+    struct timespec start, end;
+    double secs;
+    long local = 0, remote = 0, unknown = 0;
+
+    while ((c = getopt(argc, argv, "t:n:s:H:1h")) != EOF) {
+        switch (c) {
+        case 't': /* Number of threads */
+            num_threads = atoi(optarg);
+            break;
+        case 'n': /* Operations per thread */
+            num_ops = atol(optarg);
+            break;
+        case 's': /* Largest request size */
+            max_size = atoi(optarg);
+            break;
+        case 'H': /* Sub-heap size per node, in MB */
+            heap_bytes = (size_t)atol(optarg) << 20;
+            break;
+        case '1': /* One shared arena instead of one per node */
+            single_arena = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    nodes = mem_numa_nodes();
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads <= 0)
+        num_threads = (ncpus > nodes) ? ncpus : nodes;
+    if (num_ops <= 0 || max_size <= 0 || heap_bytes == 0) {
+        usage();
+        exit(1);
+    }
+
+    if (mm_numa_init(single_arena ? 1 : nodes, heap_bytes) < 0) {
+        perror("mm_numa_init");
+        exit(1);
+    }
+    printf("%d node(s)%s, %d thread(s), %s\n", nodes,
+           mem_numa_fake() ? " (fake topology)" : "", num_threads,
+           single_arena ? "one shared arena" : "one arena per node");
+
+    if ((threads = calloc(num_threads, sizeof(thread_t))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_threads; i++) {
+        threads[i].id = i;
+        threads[i].node = i % nodes;
+        threads[i].cpu = mem_numa_fake() ? -1 :
+            pick_cpu(threads[i].node, i / nodes);
+        if (pthread_create(&threads[i].tid, NULL, worker, &threads[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%6s%6s%6s%10s%10s%8s\n",
+           "thread", "node", "cpu", "local", "remote", "local%");
+    for (i = 0; i < num_threads; i++) {
+        thread_t *t = &threads[i];
+        long known = t->local + t->remote;
+
+        printf("%6d%6d%6d%10ld%10ld%7.1f%%\n", t->id, t->node, t->cpu,
+               t->local, t->remote, known ? 100.0 * t->local / known : 0.0);
+        local += t->local;
+        remote += t->remote;
+        unknown += t->unknown;
+    }
+    printf("Total: %ld local, %ld remote (%.1f%% local), %ld unknown\n",
+           local, remote,
+           (local + remote) ? 100.0 * local / (local + remote) : 0.0,
+           unknown);
+    printf("Throughput: %.0f Kops/sec\n",
+           (double)num_threads * num_ops / secs / 1e3);
+
+    free(threads);
+    return 0;
+}
+
+/*
+ * worker - Body of each benchmark thread
+ */
+static void *worker(void *arg) {
+    thread_t *t = (thread_t *)arg;
+    char *slots[SLOTS];
+    unsigned int seed = t->id + 1;
+    long i;
+    int slot, size, node;
+    cpu_set_t set;
+
+    if (t->cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(t->cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if (!single_arena)
+        mm_numa_bind_thread(t->node);
+
+    memset(slots, 0, sizeof(slots));
+    for (i = 0; i < num_ops; i++) {
+        slot = rand_r(&seed) % SLOTS;
+        if (slots[slot] != NULL) {
+            mm_free(slots[slot]);
+            slots[slot] = NULL;
+            continue;
+        }
+        size = 1 + rand_r(&seed) % max_size;
+        if ((slots[slot] = mm_malloc(size)) == NULL) {
+            fprintf(stderr, "thread %d: mm_malloc failed\n", t->id);
+            exit(1);
+        }
+        memset(slots[slot], t->id, size);  /* first touch */
+
+        if ((node = mem_addr_node(slots[slot])) < 0)
+            node = mm_numa_node(slots[slot]);
+        if (node < 0)
+            t->unknown++;
+        else if (node == t->node)
+            t->local++;
+        else
+            t->remote++;
+    }
+    for (slot = 0; slot < SLOTS; slot++)
+        if (slots[slot] != NULL)
+            mm_free(slots[slot]);
+    return NULL;
+}
+
+/*
+ * pick_cpu - Return the nth CPU (wrapping around) of node, or -1 if the
+ *     node has no CPUs we can find
+ */
+static int pick_cpu(int node, int nth) {
+    int cpu, found = 0, first = -1;
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (cpu = 0; cpu < ncpus; cpu++) {
+        if (mem_numa_node_of_cpu(cpu) != node)
+            continue;
+        if (first < 0)
+            first = cpu;
+        if (found++ == nth)
+            return cpu;
+    }
+    return (found > 0) ? pick_cpu(node, nth % found) : first;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: numabench [-h1] [-t <threads>] [-n <ops>] [-s <size>] [-H <MB>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-1         Use one shared arena instead of one per node.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <MB>    Size of each node's sub-heap (default 256).\n");
+    fprintf(stderr, "\t-n <ops>   malloc/free calls per thread (default 200000).\n");
+    fprintf(stderr, "\t-s <size>  Largest request in bytes (default 512).\n");
+    fprintf(stderr, "\t-t <n>     Number of threads (default: one per CPU).\n");
+    fprintf(stderr, "Set MEM_FAKE_NUMA=<n> to fake an n-node topology.\n");
+}
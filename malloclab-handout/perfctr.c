@@ -0,0 +1,129 @@
+/*
+ * perfctr.c - Hardware performance counters around a timed region
+ *
+ * The counters are opened in perfctr_start and closed again in
+ * perfctr_stop rather than once up front, because perf_event_open
+ * counts the thread that opened them: mdriver's forked workers have to
+ * open their own.
+ *
+ * If the kernel multiplexes the counters (more events than the PMU has
+ * registers), each count is scaled up by the fraction of the region
+ * it was actually running.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+/* What each event is, in perf_event_attr terms */
+static const struct {
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+} events[PERFCTR_NUM] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"dTLB-load-misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB |
+     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+static int fds[PERFCTR_NUM] = {-1, -1, -1, -1, -1};
+static int usable = -1;  /* bit mask of events that opened; -1: not probed */
+
+/*
+ * open_event - Open a disabled counter for one event on this thread
+ */
+static int open_event(int event) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * perfctr_available - Try each event once and remember which open
+ */
+int perfctr_available(void) {
+    int e, fd, n = 0;
+
+    if (usable < 0) {
+        usable = 0;
+        for (e = 0; e < PERFCTR_NUM; e++) {
+            if ((fd = open_event(e)) >= 0) {
+                usable |= 1 << e;
+                close(fd);
+            }
+        }
+    }
+    for (e = 0; e < PERFCTR_NUM; e++)
+        if (usable & (1 << e))
+            n++;
+    return n;
+}
+
+/*
+ * perfctr_has - Can this event be counted?
+ */
+int perfctr_has(int event) {
+    perfctr_available();
+    return (usable & (1 << event)) != 0;
+}
+
+/*
+ * perfctr_name - Return the perf(1) name of an event
+ */
+const char *perfctr_name(int event) {
+    return events[event].name;
+}
+
+/*
+ * perfctr_start - Open the usable events and start counting
+ */
+void perfctr_start(void) {
+    int e;
+
+    perfctr_available();
+    for (e = 0; e < PERFCTR_NUM; e++)
+        fds[e] = (usable & (1 << e)) ? open_event(e) : -1;
+    for (e = 0; e < PERFCTR_NUM; e++)
+        if (fds[e] >= 0)
+            ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/*
+ * perfctr_stop - Stop counting and read each event as
+ *     {value, time enabled, time running}, scaling for multiplexing
+ */
+void perfctr_stop(perfctr_counts_t *counts) {
+    unsigned long long buf[3];
+    int e;
+
+    for (e = 0; e < PERFCTR_NUM; e++)
+        if (fds[e] >= 0)
+            ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+    for (e = 0; e < PERFCTR_NUM; e++) {
+        counts->count[e] = -1;
+        if (fds[e] < 0)
+            continue;
+        if (read(fds[e], buf, sizeof(buf)) == sizeof(buf) && buf[2] > 0)
+            counts->count[e] = (long long)((double)buf[0] * buf[1] / buf[2]);
+        close(fds[e]);
+        fds[e] = -1;
+    }
+}
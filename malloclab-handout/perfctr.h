@@ -0,0 +1,36 @@
+/*
+ * perfctr.h - Hardware performance counters around a timed region
+ *
+ * Counts user-mode cycles, instructions, cache misses, branch misses
+ * and dTLB load misses with perf_event_open. Each event is opened on
+ * its own, so a machine that lacks some of them (a VM without a
+ * virtual PMU, a container with perf_event_paranoid set high) still
+ * gets the others; an event that can't be counted reads as -1.
+ */
+#ifndef __PERFCTR_H
+#define __PERFCTR_H
+
+enum {PERFCTR_CYCLES, PERFCTR_INSTRUCTIONS, PERFCTR_CACHE_MISSES,
+      PERFCTR_BRANCH_MISSES, PERFCTR_DTLB_MISSES, PERFCTR_NUM};
+
+/* The counts from one region; -1 for events that weren't counted */
+typedef struct {
+    long long count[PERFCTR_NUM];
+} perfctr_counts_t;
+
+/* Return the number of events this process can count (probed once) */
+int perfctr_available(void);
+
+/* Return nonzero if event can be counted */
+int perfctr_has(int event);
+
+/* Return a short name for an event */
+const char *perfctr_name(int event);
+
+/* Open and start the counters for the calling thread */
+void perfctr_start(void);
+
+/* Stop the counters, read them into counts, and close them */
+void perfctr_stop(perfctr_counts_t *counts);
+
+#endif /* __PERFCTR_H */
@@ -0,0 +1,310 @@
+/*
+ * cqbench.c - Stress test and throughput of the concurrent queues
+ *
+ * Starts p producer and c consumer threads on one queue.  Each producer
+ * inserts n strings, tagged with its number and a sequence number, and
+ * the consumers remove them until all have been seen.  Every consumer
+ * checks that it sees each producer's strings in the order they were
+ * inserted, and at the end we check that each string was removed
+ * exactly once.
+ *
+ * Without -p or -c, this is done with 1, 2, 4, ... producers and as
+ * many consumers, up to -t, so the table shows how throughput scales.
+ * Throughput is in millions of strings passed through the queue per
+ * second.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "cqueue.h"
+
+/* The kinds of queue we compare */
+enum {KIND_LIST, KIND_RING, NKINDS};
+
+static char *kind_names[NKINDS] = {"list", "ring"};
+
+/* Per-thread parameters and results */
+typedef struct {
+    pthread_t tid;
+    int id;            /* producer or consumer number */
+    long *count;       /* consumer: strings seen from each producer... */
+    long *sum;         /* ... and the sum of their sequence numbers */
+    long order_errors; /* consumer: strings seen out of order */
+} thread_t;
+
+/* Command line parameters */
+static int max_threads = 0;         /* 0: half the CPUs */
+static int num_producers = 0;       /* 0: scale up to max_threads */
+static int num_consumers = 0;
+static long num_ops = 1000000;      /* strings per producer */
+static size_t ring_size = 1024;     /* capacity of the ring */
+static char *value = "dolphin";     /* string each insert carries */
+
+/* The run in progress */
+static int kind;
+static cqueue_t *list;
+static cring_t *ring;
+static int producers;
+static atomic_long remaining;       /* strings still to be removed */
+static pthread_barrier_t start;
+
+static double run(int p, int c, long *errors);
+static void *producer(void *arg);
+static void *consumer(void *arg);
+static double now(void);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    double secs[NKINDS];
+    long errors = 0;
+    int c, k, t, p, cs;
+
+    while ((c = getopt(argc, argv, "hb:c:n:p:s:t:")) != -1) {
+        switch (c) {
+        case 'b': /* Ring capacity */
+            ring_size = atol(optarg);
+            break;
+        case 'c': /* Consumer threads */
+            num_consumers = atoi(optarg);
+            break;
+        case 'n': /* Strings per producer */
+            num_ops = atol(optarg);
+            break;
+        case 'p': /* Producer threads */
+            num_producers = atoi(optarg);
+            break;
+        case 's': /* String to insert */
+            value = optarg;
+            break;
+        case 't': /* Most producers (and consumers) to scale up to */
+            max_threads = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (max_threads <= 0)
+        max_threads = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+    if (max_threads <= 0)
+        max_threads = 1;
+    if (num_ops <= 0 || ring_size == 0 ||
+        num_producers < 0 || num_consumers < 0) {
+        usage();
+        exit(1);
+    }
+
+    printf("%ld strings of \"%s\" per producer, ring of %lu (Mstrings/sec)\n",
+           num_ops, value, (unsigned long)ring_size);
+    printf("%10s%10s", "producers", "consumers");
+    for (k = 0; k < NKINDS; k++)
+        printf("%10s", kind_names[k]);
+    printf("\n");
+    for (t = 1; ; t = (2 * t < max_threads) ? 2 * t : max_threads) {
+        p = num_producers ? num_producers : t;
+        cs = num_consumers ? num_consumers : t;
+        for (k = 0; k < NKINDS; k++) {
+            kind = k;
+            secs[k] = run(p, cs, &errors);
+        }
+        printf("%10d%10d", p, cs);
+        for (k = 0; k < NKINDS; k++)
+            printf("%10.2f", p * num_ops / secs[k] / 1e6);
+        printf("\n");
+        if (t == max_threads || num_producers || num_consumers)
+            break;
+    }
+    if (errors) {
+        printf("%ld errors\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * run - Pass num_ops strings from each of p producers to c consumers
+ *     through a queue of the current kind, check what they saw, and
+ *     return the time taken
+ */
+static double run(int p, int c, long *errors)
+{
+    thread_t *threads;
+    double t0, t1;
+    long count, sum, expect = num_ops * (num_ops - 1) / 2;
+    int i, j;
+
+    producers = p;
+    atomic_store(&remaining, p * num_ops);
+    if (kind == KIND_LIST)
+        list = cq_new();
+    else
+        ring = cr_new(ring_size);
+    if ((kind == KIND_LIST ? (void *)list : (void *)ring) == NULL ||
+        (threads = calloc(p + c, sizeof(thread_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    pthread_barrier_init(&start, NULL, p + c + 1);
+    for (i = 0; i < p + c; i++) {
+        threads[i].id = i < p ? i : i - p;
+        if (i >= p) {
+            threads[i].count = calloc(p, sizeof(long));
+            threads[i].sum = calloc(p, sizeof(long));
+            if (threads[i].count == NULL || threads[i].sum == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+        }
+        if (pthread_create(&threads[i].tid, NULL,
+                           i < p ? producer : consumer, &threads[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&start);
+    t0 = now();
+    for (i = 0; i < p + c; i++)
+        pthread_join(threads[i].tid, NULL);
+    t1 = now();
+    pthread_barrier_destroy(&start);
+
+    for (j = 0; j < p; j++) {
+        count = sum = 0;
+        for (i = p; i < p + c; i++) {
+            count += threads[i].count[j];
+            sum += threads[i].sum[j];
+        }
+        if (count != num_ops || sum != expect) {
+            fprintf(stderr, "%s: producer %d: %ld strings removed, expected %ld\n",
+                    kind_names[kind], j, count, num_ops);
+            (*errors)++;
+        }
+    }
+    for (i = p; i < p + c; i++) {
+        if (threads[i].order_errors) {
+            fprintf(stderr, "%s: consumer %d saw %ld strings out of order\n",
+                    kind_names[kind], threads[i].id, threads[i].order_errors);
+            *errors += threads[i].order_errors;
+        }
+        free(threads[i].count);
+        free(threads[i].sum);
+    }
+    free(threads);
+    if (kind == KIND_LIST)
+        cq_free(list);
+    else
+        cr_free(ring);
+    return t1 - t0;
+}
+
+/*
+ * producer - Insert num_ops strings "<producer> <seq> <value>"
+ */
+static void *producer(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    size_t size = strlen(value) + 32;
+    char *buf = malloc(size);
+    long seq;
+    bool ok;
+
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    pthread_barrier_wait(&start);
+    for (seq = 0; seq < num_ops; seq++) {
+        snprintf(buf, size, "%d %ld %s", t->id, seq, value);
+        do {
+            ok = kind == KIND_LIST ? cq_insert_tail(list, buf) :
+                cr_insert_tail(ring, buf);
+            if (!ok)
+                sched_yield();  /* The ring is full */
+        } while (!ok);
+    }
+    free(buf);
+    return NULL;
+}
+
+/*
+ * consumer - Remove strings until every producer's have all been seen
+ */
+static void *consumer(void *arg)
+{
+    thread_t *t = (thread_t *)arg;
+    size_t size = strlen(value) + 32;
+    char *buf = malloc(size);
+    long *last = malloc(producers * sizeof(long));
+    long seq;
+    char *end;
+    int p;
+    bool ok;
+
+    if (buf == NULL || last == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (p = 0; p < producers; p++)
+        last[p] = -1;
+    pthread_barrier_wait(&start);
+    while (atomic_load_explicit(&remaining, memory_order_relaxed) > 0) {
+        ok = kind == KIND_LIST ? cq_remove_head(list, buf, size) :
+            cr_remove_head(ring, buf, size);
+        if (!ok) {
+            sched_yield();  /* Empty, for now */
+            continue;
+        }
+        atomic_fetch_sub_explicit(&remaining, 1, memory_order_relaxed);
+        p = strtol(buf, &end, 10);
+        seq = strtol(end, NULL, 10);
+        if (p < 0 || p >= producers) {
+            t->order_errors++;
+            continue;
+        }
+        if (seq <= last[p])
+            t->order_errors++;
+        last[p] = seq;
+        t->count[p]++;
+        t->sum[p] += seq;
+    }
+    free(last);
+    free(buf);
+    return NULL;
+}
+
+/*
+ * now - Seconds on the monotonic clock
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: cqbench [-h] [-t <threads>] [-p <producers>] [-c <consumers>]\n"
+            "               [-n <strings>] [-b <capacity>] [-s <string>]\n");
+    fprintf(stderr, "\t-h           Print this message\n");
+    fprintf(stderr, "\t-t <n>       Scale up to n producers and n consumers (default: half the CPUs)\n");
+    fprintf(stderr, "\t-p <n>       Run once, with n producers\n");
+    fprintf(stderr, "\t-c <n>       Run once, with n consumers\n");
+    fprintf(stderr, "\t-n <n>       Strings per producer (default 1000000)\n");
+    fprintf(stderr, "\t-b <n>       Capacity of the ring (default 1024)\n");
+    fprintf(stderr, "\t-s <string>  String to insert (default dolphin)\n");
+}
@@ -0,0 +1,386 @@
+/*
+ * Concurrent queues of strings (see cqueue.h).
+ *
+ * Hazard pointers.
+ * Every thread that uses a cqueue_t gets a record with HP_SLOTS hazard
+ * pointers, in which it publishes the nodes it is about to read.  The
+ * records are on a list that only grows; a thread's record is marked
+ * inactive when it exits, and reused by the next new thread.  A removed
+ * node is retired to its remover's record, and when enough have built
+ * up, the thread frees those that no record's hazard pointers name.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "cqueue.h"
+
+/* Hazard pointers per thread: the head (or tail) and the node after it */
+#define HP_SLOTS 2
+
+/* Retired nodes a thread collects, beyond the number of hazard
+   pointers, before it looks for ones to free */
+#define HP_RETIRE_MIN 64
+
+typedef struct HPREC {
+    _Atomic(void *) hp[HP_SLOTS];
+    atomic_bool active;       /* Held by a live thread */
+    struct HPREC *next;       /* Never changes once the record is listed */
+    /* Retired nodes, only touched by the thread holding the record */
+    void **retired;
+    int nretired;
+    int maxretired;
+} hp_rec_t;
+
+static _Atomic(hp_rec_t *) hp_records = NULL;
+static atomic_int hp_nrecords = 0;
+
+/* This thread's record, which the key hands back at thread exit */
+static __thread hp_rec_t *hp_mine = NULL;
+static pthread_key_t hp_key;
+static pthread_once_t hp_once = PTHREAD_ONCE_INIT;
+
+static void hp_release(void *arg);
+static void hp_scan(hp_rec_t *r);
+
+static void hp_init(void)
+{
+    pthread_key_create(&hp_key, hp_release);
+}
+
+/* Return this thread's record, finding one if it has none yet */
+static hp_rec_t *hp_get(void)
+{
+    hp_rec_t *r;
+    bool idle;
+    if (hp_mine != NULL)
+        return hp_mine;
+    pthread_once(&hp_once, hp_init);
+    for (r = atomic_load(&hp_records); r != NULL; r = r->next) {
+        idle = false;
+        if (!atomic_load(&r->active) &&
+            atomic_compare_exchange_strong(&r->active, &idle, true))
+            break;
+    }
+    if (r == NULL) {
+        if ((r = calloc(1, sizeof(hp_rec_t))) == NULL)
+            return NULL;
+        atomic_init(&r->active, true);
+        r->next = atomic_load(&hp_records);
+        while (!atomic_compare_exchange_weak(&hp_records, &r->next, r))
+            ;
+        atomic_fetch_add(&hp_nrecords, 1);
+    }
+    hp_mine = r;
+    pthread_setspecific(hp_key, r);
+    return r;
+}
+
+/* Give up this thread's record when it exits */
+static void hp_release(void *arg)
+{
+    hp_rec_t *r = arg;
+    int i;
+    for (i = 0; i < HP_SLOTS; i++)
+        atomic_store(&r->hp[i], NULL);
+    hp_scan(r);
+    hp_mine = NULL;
+    atomic_store(&r->active, false);
+}
+
+/*
+  Publish the node that *src points to in hazard pointer i, and return
+  it.  Once we have reread *src after publishing, nobody can free the
+  node until we clear the pointer.
+*/
+static cq_node_t *hp_protect(hp_rec_t *r, int i, _Atomic(cq_node_t *) *src)
+{
+    cq_node_t *p = atomic_load(src);
+    cq_node_t *seen;
+    do {
+        seen = p;
+        atomic_store(&r->hp[i], seen);
+        p = atomic_load(src);
+    } while (p != seen);
+    return p;
+}
+
+static void hp_clear(hp_rec_t *r)
+{
+    int i;
+    for (i = 0; i < HP_SLOTS; i++)
+        atomic_store(&r->hp[i], NULL);
+}
+
+static int ptr_compare(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(void * const *)a;
+    uintptr_t y = (uintptr_t)*(void * const *)b;
+    return (x > y) - (x < y);
+}
+
+/* Free the retired nodes that no hazard pointer names */
+static void hp_scan(hp_rec_t *r)
+{
+    hp_rec_t *first = atomic_load(&hp_records);
+    hp_rec_t *other;
+    void **hazards;
+    void *p;
+    int nhazards = 0;
+    int i, max = 0, kept = 0;
+    if (r->nretired == 0)
+        return;
+    /* Records listed after we read first belong to threads that started
+       after our retired nodes were off the list, so can't name them */
+    for (other = first; other != NULL; other = other->next)
+        max += HP_SLOTS;
+    if ((hazards = malloc(max * sizeof(void *))) == NULL)
+        return;
+    for (other = first; other != NULL; other = other->next)
+        for (i = 0; i < HP_SLOTS; i++)
+            if ((p = atomic_load(&other->hp[i])) != NULL)
+                hazards[nhazards++] = p;
+    qsort(hazards, nhazards, sizeof(void *), ptr_compare);
+    for (i = 0; i < r->nretired; i++) {
+        p = r->retired[i];
+        if (bsearch(&p, hazards, nhazards, sizeof(void *), ptr_compare))
+            r->retired[kept++] = p;
+        else
+            free(p);
+    }
+    r->nretired = kept;
+    free(hazards);
+}
+
+/* Hand node p, which is off the list, over to be freed */
+static void hp_retire(hp_rec_t *r, void *p)
+{
+    int want = HP_RETIRE_MIN + 2 * atomic_load(&hp_nrecords) * HP_SLOTS;
+    void **grown;
+    if (r->nretired == r->maxretired) {
+        grown = realloc(r->retired, want * sizeof(void *));
+        if (grown != NULL) {
+            r->retired = grown;
+            r->maxretired = want;
+        }
+        /* Otherwise wait for the other threads to move on */
+        while (r->nretired == r->maxretired) {
+            hp_scan(r);
+            if (r->nretired == r->maxretired)
+                sched_yield();
+        }
+    }
+    r->retired[r->nretired++] = p;
+    if (r->nretired >= want)
+        hp_scan(r);
+}
+
+/* Round size up to a multiple of CQ_LINE, as aligned_alloc wants */
+static size_t line_round(size_t size)
+{
+    return (size + CQ_LINE - 1) & ~(size_t)(CQ_LINE - 1);
+}
+
+/*
+  Lock-free list.
+ */
+
+cqueue_t *cq_new(void)
+{
+    cqueue_t *q = aligned_alloc(CQ_LINE, line_round(sizeof(cqueue_t)));
+    cq_node_t *dummy = malloc(offsetof(cq_node_t, data) + 1);
+    if (q == NULL || dummy == NULL) {
+        free(q);
+        free(dummy);
+        return NULL;
+    }
+    atomic_init(&dummy->next, NULL);
+    dummy->data[0] = '\0';
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    return q;
+}
+
+void cq_free(cqueue_t *q)
+{
+    cq_node_t *node, *next;
+    if (q == NULL)
+        return;
+    for (node = atomic_load(&q->head); node != NULL; node = next) {
+        next = atomic_load(&node->next);
+        free(node);
+    }
+    free(q);
+    if (hp_mine != NULL)
+        hp_scan(hp_mine);
+}
+
+bool cq_insert_tail(cqueue_t *q, char *s)
+{
+    hp_rec_t *r;
+    cq_node_t *node, *tail, *next;
+    size_t len;
+    if (q == NULL || (r = hp_get()) == NULL)
+        return false;
+    len = strlen(s) + 1;
+    if ((node = malloc(offsetof(cq_node_t, data) + len)) == NULL)
+        return false;
+    memcpy(node->data, s, len);
+    atomic_init(&node->next, NULL);
+    for (;;) {
+        tail = hp_protect(r, 0, &q->tail);
+        next = atomic_load(&tail->next);
+        if (next != NULL) {
+            /* Tail is behind: help move it along, and try again */
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&tail->next, &next, node))
+            break;
+    }
+    /* If this fails, someone has already moved the tail past node */
+    atomic_compare_exchange_strong(&q->tail, &tail, node);
+    hp_clear(r);
+    return true;
+}
+
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize)
+{
+    hp_rec_t *r;
+    cq_node_t *head, *tail, *next;
+    if (q == NULL || (r = hp_get()) == NULL)
+        return false;
+    for (;;) {
+        head = hp_protect(r, 0, &q->head);
+        tail = atomic_load(&q->tail);
+        next = atomic_load(&head->next);
+        atomic_store(&r->hp[1], next);
+        /* While head is still the head, next can't have been retired */
+        if (head != atomic_load(&q->head))
+            continue;
+        if (next == NULL) {
+            hp_clear(r);
+            return false;
+        }
+        if (head == tail) {
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&q->head, &head, next))
+            break;
+    }
+    /* next is the new dummy, but our hazard pointer keeps its string */
+    if (sp != NULL && bufsize > 0) {
+        strncpy(sp, next->data, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    hp_clear(r);
+    hp_retire(r, head);
+    return true;
+}
+
+/*
+  Bounded ring.
+  Positions count up forever; position pos uses slot pos & mask.  A slot
+  is free for the insert at pos when its seq is pos, and holds a string
+  for the remove at pos when its seq is pos+1.  The remove then sets it
+  to pos+capacity, for the insert one lap later.
+ */
+
+cring_t *cr_new(size_t capacity)
+{
+    cring_t *r;
+    size_t n = 2;
+    size_t i;
+    while (n < capacity)
+        n <<= 1;
+    if ((r = aligned_alloc(CQ_LINE, line_round(sizeof(cring_t)))) == NULL)
+        return NULL;
+    if ((r->slots = malloc(n * sizeof(cr_slot_t))) == NULL) {
+        free(r);
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+        atomic_init(&r->slots[i].seq, i);
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->mask = n - 1;
+    return r;
+}
+
+void cr_free(cring_t *r)
+{
+    size_t pos;
+    if (r == NULL)
+        return;
+    for (pos = atomic_load(&r->head); pos != atomic_load(&r->tail); pos++)
+        free(r->slots[pos & r->mask].value);
+    free(r->slots);
+    free(r);
+}
+
+bool cr_insert_tail(cring_t *r, char *s)
+{
+    cr_slot_t *slot;
+    size_t pos, seq, len;
+    char *copy;
+    if (r == NULL)
+        return false;
+    len = strlen(s) + 1;
+    if ((copy = malloc(len)) == NULL)
+        return false;
+    memcpy(copy, s, len);
+    pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if ((long)(seq - pos) < 0) {
+            free(copy);  /* Full: the slot still has last lap's string */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+    slot->value = copy;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool cr_remove_head(cring_t *r, char *sp, size_t bufsize)
+{
+    cr_slot_t *slot;
+    size_t pos, seq;
+    char *value;
+    if (r == NULL)
+        return false;
+    pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos + 1) {
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if ((long)(seq - (pos + 1)) < 0) {
+            return false;  /* Empty: nothing inserted at pos yet */
+        } else {
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+    value = slot->value;
+    atomic_store_explicit(&slot->seq, pos + r->mask + 1, memory_order_release);
+    if (sp != NULL && bufsize > 0) {
+        strncpy(sp, value, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    free(value);
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * Concurrent queues of strings
+ *
+ * These can be used by any number of producer and consumer threads at
+ * once, without locks.  Like q_insert_tail and q_remove_head, an insert
+ * stores a copy of the string, and a remove copies it out to the
+ * caller's buffer.
+ *
+ * cqueue_t is the linked list of Michael and Scott ("Simple, Fast, and
+ * Practical Non-Blocking and Blocking Concurrent Queue Algorithms",
+ * PODC 1996).  Removed nodes are freed using hazard pointers (Michael,
+ * "Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects",
+ * IEEE TPDS 2004), so a node is never freed while another thread may
+ * still be reading it.  Each thread frees its removed nodes in batches;
+ * a thread's last batch is freed when it exits, as far as the other
+ * threads' hazard pointers allow.
+ *
+ * cring_t is a bounded ring of string pointers (after D. Vyukov's
+ * bounded MPMC queue).  It never has to reclaim anything, but an insert
+ * fails when the ring is full.
+ *
+ * Both use the C library's malloc and free.  The harness's versions
+ * keep unlocked global state, so they can't be used from several
+ * threads.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Things written by different threads are kept this many bytes apart */
+#define CQ_LINE 64
+
+/************** Lock-free list ****************************/
+
+/* List node.  The first node on the list is a dummy; the strings are
+   in the ones after it */
+typedef struct CNODE {
+    _Atomic(struct CNODE *) next;
+    char data[];   /* The string, allocated in one block with the node */
+} cq_node_t;
+
+/* Queue structure */
+typedef struct {
+    _Alignas(CQ_LINE) _Atomic(cq_node_t *) head;  /* The dummy node */
+    _Alignas(CQ_LINE) _Atomic(cq_node_t *) tail;  /* Last node, or nearly */
+} cqueue_t;
+
+/*
+  Create empty queue.
+  Return NULL if could not allocate space.
+*/
+cqueue_t *cq_new(void);
+
+/*
+  Free all storage used by queue.
+  No other thread may be using the queue.
+  No effect if q is NULL.
+*/
+void cq_free(cqueue_t *q);
+
+/*
+  Insert a copy of string s at tail of queue.
+  Return false if q is NULL or could not allocate space.
+*/
+bool cq_insert_tail(cqueue_t *q, char *s);
+
+/*
+  Remove element from head of queue.
+  Return false if q is NULL or empty.
+  If sp is non-NULL, the removed string is copied to *sp, as by
+  q_remove_head (up to bufsize-1 characters, plus a null terminator).
+*/
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize);
+
+/************** Bounded ring ******************************/
+
+/* Slot of a ring.  seq says whose turn it is to use the slot: the
+   producer of position seq, or the consumer of position seq-1 */
+typedef struct {
+    _Atomic size_t seq;
+    char *value;
+} cr_slot_t;
+
+/* Ring structure */
+typedef struct {
+    _Alignas(CQ_LINE) _Atomic size_t head;  /* Next position to remove */
+    _Alignas(CQ_LINE) _Atomic size_t tail;  /* Next position to insert */
+    _Alignas(CQ_LINE) size_t mask;          /* Capacity - 1 */
+    cr_slot_t *slots;
+} cring_t;
+
+/*
+  Create empty ring holding up to capacity strings (rounded up to a
+  power of two).
+  Return NULL if could not allocate space.
+*/
+cring_t *cr_new(size_t capacity);
+
+/*
+  Free all storage used by ring.
+  No other thread may be using the ring.
+  No effect if r is NULL.
+*/
+void cr_free(cring_t *r);
+
+/*
+  Insert a copy of string s at tail of ring.
+  Return false if r is NULL, full, or could not allocate space.
+*/
+bool cr_insert_tail(cring_t *r, char *s);
+
+/*
+  Remove element from head of ring, as cq_remove_head does.
+  Return false if r is NULL or empty.
+*/
+bool cr_remove_head(cring_t *r, char *sp, size_t bufsize);
@@ -30,6 +30,17 @@ class Tracer:
         15 : "trace-15-perf"
         }
 
+    # Traces of the operations and representations added beyond the
+    # assignment (splice, bulk operations, unrolled queues, node pools).
+    # They run after the scored traces, but carry no points.
+    extraDict = {
+        16 : "trace-16-splice",
+        17 : "trace-17-bulk",
+        18 : "trace-18-malloc",
+        19 : "trace-19-unrolled",
+        20 : "trace-20-pool"
+        }
+
     traceProbs = {
         1 : "Trace-01",
         2 : "Trace-02",
@@ -57,11 +68,16 @@ class Tracer:
         self.verbLevel = verbLevel
         self.autograde = autograde
 
+    def traceName(self, tid):
+        if tid in self.traceDict:
+            return self.traceDict[tid]
+        return self.extraDict[tid]
+
     def runTrace(self, tid):
-        if not tid in self.traceDict:
+        if not tid in self.traceDict and not tid in self.extraDict:
             print "ERROR: No trace with id %d" % tid
             return False
-        fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
+        fname = "%s/%s.cmd" % (self.traceDirectory, self.traceName(tid))
         vname = "%d" % self.verbLevel
         clist = [self.qtest, "-v", vname, "-f", fname]
         try:
@@ -80,11 +96,16 @@ class Tracer:
         print "---\tTrace\t\tPoints"
         if tid == 0:
             tidList = self.traceDict.keys()
-        else:
-            if not tid in self.traceDict:
-                print "ERROR: Invalid trace ID %d" % tid
-                return
+            extraList = self.extraDict.keys()
+        elif tid in self.traceDict:
             tidList = [tid]
+            extraList = []
+        elif tid in self.extraDict:
+            tidList = []
+            extraList = [tid]
+        else:
+            print "ERROR: Invalid trace ID %d" % tid
+            return
         score = 0
         maxscore = 0
         for t in tidList:
@@ -98,7 +119,14 @@ class Tracer:
             score += tval
             maxscore += maxval
             scoreDict[t] = tval
-        print "---\tTOTAL\t\t%d/%d" % (score, maxscore)
+        if tidList:
+            print "---\tTOTAL\t\t%d/%d" % (score, maxscore)
+        for t in extraList:
+            tname = self.extraDict[t]
+            if self.verbLevel > 0:
+                print "+++ TESTING trace %s:" % tname
+            ok = self.runTrace(t)
+            print "---\t%s\t%s" % (tname, "ok" if ok else "FAILED")
         if self.autograde:
             # Generate JSON string
             jstring = '{"scores": {'
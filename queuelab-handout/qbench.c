@@ -0,0 +1,168 @@
+/*
+ * qbench.c - Throughput of the queue representations
+ *
+ * Builds a queue of n copies of a string with q_insert_tail, then walks
+ * it with the q_iter functions, reverses it, and frees it, as a linked
+ * list and unrolled, each with and without a node pool.  Each step is
+ * timed separately, and the fastest of the runs is reported in millions
+ * of elements per second.
+ *
+ * Unlike qtest, qbench uses the real malloc and free (queue.c is
+ * compiled with INTERNAL defined), so the numbers don't include the
+ * harness's checking.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "queue.h"
+
+/* The steps we time */
+enum {STEP_INSERT, STEP_WALK, STEP_REVERSE, STEP_FREE, NSTEPS};
+
+static char *step_names[NSTEPS] = {"insert", "walk", "reverse", "free"};
+
+/* The kinds of queue we compare */
+#define NKINDS 4
+
+static struct {
+    char *name;
+    int unrolled;
+    int pooled;
+} kinds[NKINDS] = {
+    {"linked", 0, 0},
+    {"+pool", 0, 1},
+    {"unrolled", 1, 0},
+    {"+pool", 1, 1},
+};
+
+/* Command line parameters */
+static int num_elements = 1000000;  /* elements per queue */
+static int num_runs = 5;            /* keep the fastest of this many */
+static char *value = "dolphin";     /* string to fill the queue with */
+
+static void run(int kind, double *best);
+static double now(void);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    double best[NKINDS][NSTEPS];
+    int c, s, k;
+
+    while ((c = getopt(argc, argv, "hn:r:s:")) != -1) {
+        switch (c) {
+        case 'n': /* Elements per queue */
+            num_elements = atoi(optarg);
+            break;
+        case 'r': /* Runs per kind of queue */
+            num_runs = atoi(optarg);
+            break;
+        case 's': /* String to insert */
+            value = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (num_elements <= 0 || num_runs <= 0) {
+        usage();
+        exit(1);
+    }
+
+    for (k = 0; k < NKINDS; k++) {
+        for (s = 0; s < NSTEPS; s++)
+            best[k][s] = 0;
+        run(k, best[k]);
+    }
+
+    printf("%d elements of \"%s\", best of %d runs (Melem/sec)\n",
+           num_elements, value, num_runs);
+    printf("%-10s", "step");
+    for (k = 0; k < NKINDS; k++)
+        printf("%10s", kinds[k].name);
+    printf("\n");
+    for (s = 0; s < NSTEPS; s++) {
+        printf("%-10s", step_names[s]);
+        for (k = 0; k < NKINDS; k++)
+            printf("%10.1f", num_elements / best[k][s] / 1e6);
+        printf("\n");
+    }
+    return 0;
+}
+
+/*
+ * run - Time each step on queues of one kind, keeping the fastest
+ *     time of each in best
+ */
+static void run(int kind, double *best)
+{
+    double t[NSTEPS + 1];
+    queue_t *q;
+    q_iter_t it;
+    char *v;
+    long sum;
+    int r, i, s;
+
+    queue_unrolled = kinds[kind].unrolled;
+    queue_pooled = kinds[kind].pooled;
+    for (r = 0; r < num_runs; r++) {
+        t[0] = now();
+        if ((q = q_new()) == NULL) {
+            fprintf(stderr, "q_new failed\n");
+            exit(1);
+        }
+        for (i = 0; i < num_elements; i++) {
+            if (!q_insert_tail(q, value)) {
+                fprintf(stderr, "q_insert_tail failed\n");
+                exit(1);
+            }
+        }
+        t[1] = now();
+        sum = 0;
+        q_iter_init(&it, q);
+        while ((v = q_iter_next(&it)) != NULL)
+            sum += v[0];  /* touch the string, as show_queue would */
+        t[2] = now();
+        q_reverse(q);
+        t[3] = now();
+        q_free(q);
+        t[4] = now();
+
+        if (sum != (long)num_elements * value[0]) {
+            fprintf(stderr, "walk saw the wrong strings\n");
+            exit(1);
+        }
+        for (s = 0; s < NSTEPS; s++)
+            if (best[s] == 0 || t[s + 1] - t[s] < best[s])
+                best[s] = t[s + 1] - t[s];
+    }
+}
+
+/*
+ * now - Seconds on the monotonic clock
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: qbench [-h] [-n <elements>] [-r <runs>] [-s <string>]\n");
+    fprintf(stderr, "\t-h           Print this message\n");
+    fprintf(stderr, "\t-n <n>       Elements per queue (default 1000000)\n");
+    fprintf(stderr, "\t-r <n>       Keep the fastest of <n> runs (default 5)\n");
+    fprintf(stderr, "\t-s <string>  String to fill the queue with (default dolphin)\n");
+}
@@ -16,8 +16,8 @@
 #define STRINGPAD MAXSTRING
 
 /*
-  It is a bit sketchy to use this #include file on the solution version of the code.
-  OK as long as head field of queue_t structure is in first position in solution code
+  qtest only looks inside a queue through q_peek_head, q_peek_tail and
+  the q_iter functions, so it works with either representation.
 */
 #include "queue.h"
 
@@ -50,6 +50,8 @@ int string_length = MAXSTRING;
 
 /****** Forward declarations ******/
 static bool show_queue(int vlevel);
+static bool insert_bulk(bool head, char *inserts, int reps);
+static bool check_copies(bool head, char *inserts);
 bool do_new(int argc, char *argv[]);
 bool do_free(int argc, char *argv[]);
 bool do_insert_head(int argc, char *argv[]);
@@ -57,6 +59,7 @@ bool do_insert_tail(int argc, char *argv[]);
 bool do_remove_head(int argc, char *argv[]);
 bool do_remove_head_quiet(int argc, char *argv[]);
 bool do_reverse(int argc, char *argv[]);
+bool do_splice(int argc, char *argv[]);
 bool do_size(int argc, char *argv[]);
 bool do_show(int argc, char *argv[]);
 
@@ -74,9 +77,11 @@ static void console_init() {
     add_cmd("rh", do_remove_head,
             " [str]          | Remove from head of queue.  Optionally compare to expected value str");
     add_cmd("rhq", do_remove_head_quiet,
-            "                | Remove from head of queue without reporting value.");
+            " [n]            | Remove from head of queue n times without reporting values (default: n == 1)");
     add_cmd("reverse", do_reverse,
             "                | Reverse queue");
+    add_cmd("splice", do_splice,
+            " str [n]        | Splice a new queue holding n copies of str onto the tail (default: n == 1)");
     add_cmd("size", do_size,
             " [n]            | Compute queue size n times (default: n == 1)");
     add_cmd("show", do_show,
@@ -84,6 +89,8 @@ static void console_init() {
     add_param("length", &string_length, "Maximum length of displayed string", NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent", NULL);
     add_param("fail", &fail_limit, "Number of times allow queue operations to return false", NULL);
+    add_param("unrolled", &queue_unrolled, "Create unrolled (chunked) queues with new", NULL);
+    add_param("pool", &queue_pooled, "Create queues with a node pool with new", NULL);
 }
 
 bool do_new(int argc, char *argv[])
@@ -154,24 +161,27 @@ bool do_insert_head(int argc, char *argv[])
     if (q == NULL)
         report(3, "Warning: Calling insert head on null queue");
     error_check();
+    if (reps > 1)
+        return insert_bulk(true, inserts, reps);
     if (exception_setup(true)) {
         for (r = 0; ok && r < reps; r++) {
             bool rval = q_insert_head(q, inserts);
             if (rval) {
+                char *value = q_peek_head(q);
                 qcnt++;
-                if (!q->head->value) {
+                if (!value) {
                     report(1, "ERROR: Failed to save copy of string in list");
                     ok = false;
-                } else if (r == 0 && inserts == q->head->value) {
+                } else if (r == 0 && inserts == value) {
                     report(1, "ERROR: Need to allocate and copy string for new list element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == q->head->value) {
+                } else if (r == 1 && lasts == value) {
                     report(1, "ERROR: Need to allocate separate string for each list element");
                     ok = false;
                     break;
                 }
-                lasts = q->head->value;
+                lasts = value;
             } else {
                 fail_count++;
                 if (fail_count < fail_limit)
@@ -189,6 +199,75 @@ bool do_insert_head(int argc, char *argv[])
     return ok;
 }
 
+/*
+  Insert reps copies of inserts at the head (or tail) with the bulk
+  functions.  As with single inserts, each copy that can't be
+  allocated counts as one failed operation, and we go on with the rest.
+*/
+static bool insert_bulk(bool head, char *inserts, int reps)
+{
+    bool ok = true;
+    int left = reps;
+    int got;
+    if (exception_setup(true)) {
+        while (ok && left > 0) {
+            got = head ? q_insert_head_n(q, inserts, left) :
+                q_insert_tail_n(q, inserts, left);
+            qcnt += got;
+            left -= got;
+            if (left > 0) {
+                left--;
+                fail_count++;
+                if (fail_count < fail_limit)
+                    report(2, "Insertion of %s failed", inserts);
+                else {
+                    report(1, "ERROR: Insertion of %s failed (%d failures total)", inserts, fail_count);
+                    ok = false;
+                }
+            }
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+    if (ok && qcnt > 0)
+        ok = check_copies(head, inserts);
+    show_queue(3);
+    return ok;
+}
+
+/*
+  Check that the two strings at the head (or tail) of the queue are
+  copies of inserts, and not inserts itself or a shared copy.
+*/
+static bool check_copies(bool head, char *inserts)
+{
+    q_iter_t it;
+    char *first, *second;
+    bool ok = true;
+    if (exception_setup(true)) {
+        if (head) {
+            q_iter_init(&it, q);
+            first = q_iter_next(&it);
+            second = q_iter_next(&it);
+        } else {
+            first = q_peek_tail(q);
+            second = NULL;
+        }
+        if (!first) {
+            report(1, "ERROR: Failed to save copy of string in list");
+            ok = false;
+        } else if (first == inserts) {
+            report(1, "ERROR: Need to allocate and copy string for new list element");
+            ok = false;
+        } else if (second == first) {
+            report(1, "ERROR: Need to allocate separate string for each list element");
+            ok = false;
+        }
+    }
+    exception_cancel();
+    return ok && !error_check();
+}
+
 bool do_insert_tail(int argc, char *argv[])
 {
     char *inserts;
@@ -209,12 +288,14 @@ bool do_insert_tail(int argc, char *argv[])
     if (q == NULL)
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
+    if (reps > 1)
+        return insert_bulk(false, inserts, reps);
     if (exception_setup(true)) {
         for (r = 0; ok && r < reps; r++) {
             bool rval = q_insert_tail(q, inserts);
             if (rval) {
                 qcnt ++;
-                if (!q->head->value) {
+                if (!q_peek_tail(q)) {
                     report(1, "ERROR: Failed to save copy of string in list");
                     ok = false;
                 }
@@ -265,7 +346,7 @@ bool do_remove_head(int argc, char *argv[])
 
     if (q == NULL)
         report(3, "Warning: Calling remove head on null queue");
-    else if (q->head == NULL)
+    else if (q_peek_head(q) == NULL)
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
     bool rval = false;
@@ -305,16 +386,42 @@ bool do_remove_head(int argc, char *argv[])
 
 bool do_remove_head_quiet(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    int reps = 1;
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
         return false;
     }
+    if (argc == 2) {
+        if (!get_int(argv[1], &reps)) {
+            report(1, "Invalid number of removals '%s'", argv[1]);
+            return false;
+        }
+    }
     bool ok = true;
     if (q == NULL)
         report(3, "Warning: Calling remove head on null queue");
-    else if (q->head == NULL)
+    else if (q_peek_head(q) == NULL)
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
+    if (reps > 1) {
+        int got = 0;
+        if (exception_setup(true))
+            got = q_remove_head_n(q, NULL, 0, reps);
+        exception_cancel();
+        qcnt -= got;
+        report(2, "Removed %d elements from queue", got);
+        if (got < reps) {
+            fail_count += reps - got;
+            if (fail_count < fail_limit)
+                report(2, "%d removals failed", reps - got);
+            else {
+                report(1, "ERROR: %d removals failed (%d failures total)", reps - got, fail_count);
+                ok = false;
+            }
+        }
+        show_queue(3);
+        return ok && !error_check();
+    }
     bool rval = false;
     if (exception_setup(true))
         rval = q_remove_head(q, NULL, 0);
@@ -353,6 +460,59 @@ bool do_reverse(int argc, char *argv[])
     return !error_check();
 }
 
+bool do_splice(int argc, char *argv[])
+{
+    char *inserts;
+    int reps = 1;
+    int got = 0;
+    bool ok = true;
+    bool rval = false;
+    queue_t *q2 = NULL;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    inserts = argv[1];
+    if (argc == 3) {
+        if (!get_int(argv[2], &reps)) {
+            report(1, "Invalid number of insertions '%s'", argv[2]);
+            return false;
+        }
+    }
+    if (q == NULL)
+        report(3, "Warning: Calling splice on null queue");
+    error_check();
+    if (exception_setup(true)) {
+        q2 = q_new();
+        got = q_insert_tail_n(q2, inserts, reps);
+        rval = q_splice(q, q2);
+        if (rval && q_size(q2) != 0) {
+            report(1, "ERROR: Queue spliced from still has %d elements", q_size(q2));
+            ok = false;
+        }
+    }
+    exception_cancel();
+    if (rval) {
+        qcnt += got;
+        report(2, "Spliced %d copies of %s onto queue", got, inserts);
+    }
+    if (!rval || got < reps) {
+        /* Each copy we couldn't insert counts as a failure */
+        fail_count += rval ? reps - got : 1;
+        if (fail_count < fail_limit)
+            report(2, "Splice of %s failed", inserts);
+        else {
+            report(1, "ERROR: Splice of %s failed (%d failures total)", inserts, fail_count);
+            ok = false;
+        }
+    }
+    if (exception_setup(true))
+        q_free(q2);
+    exception_cancel();
+    show_queue(3);
+    return ok && !error_check();
+}
+
 bool do_size(int argc, char *argv[])
 {
     if (argc != 1 && argc != 2) {
@@ -407,12 +567,15 @@ static bool show_queue(int vlevel)
         return true;
     }
     report_noreturn(vlevel, "q = [");
-    list_ele_t *e = q->head;
+    q_iter_t it;
+    char *value = NULL;
     if (exception_setup(true)) {
-        while (ok && e && cnt < qcnt) {
+        q_iter_init(&it, q);
+        value = q_iter_next(&it);
+        while (ok && value && cnt < qcnt) {
             if (cnt < big_queue_size)
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
-            e = e->next;
+                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", value);
+            value = q_iter_next(&it);
             cnt++;
             ok = ok && !error_check();
         }
@@ -422,7 +585,7 @@ static bool show_queue(int vlevel)
         report(vlevel, " ... ]");
         return false;
     }
-    if (e == NULL) {
+    if (value == NULL) {
         if (cnt <= big_queue_size)
             report(vlevel, "]");
         else
@@ -7,16 +7,90 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a singly-linked list to represent the set of queue elements,
+ * or an unrolled list of chunks of string pointers (see queue.h).
+ * Either can get its elements and strings from a per-queue node pool.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "harness.h"
 #include "queue.h"
 
+/* Set by qtest's "option unrolled" */
+int queue_unrolled = 0;
+
+/* Set by qtest's "option pool" */
+int queue_pooled = 0;
+
+/* The unrolled versions of the q_* functions */
+static void uq_free(queue_t *q);
+static int uq_insert_head_n(queue_t *q, char *s, size_t len, int n);
+static int uq_insert_tail_n(queue_t *q, char *s, size_t len, int n);
+static int uq_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n);
+static void uq_reverse(queue_t *q);
+static void uq_splice(queue_t *q, queue_t *q2);
+
+/* The node pool */
+static void *pool_alloc(q_pool_t *p, size_t size);
+static void pool_release(q_pool_t *p, void *b, size_t size);
+static void pool_destroy(q_pool_t *p);
+static void pool_splice(q_pool_t *p, q_pool_t *p2);
+
+/*
+  Allocate (release) size bytes for an element or string of q, from its
+  pool if it has one.  Return NULL if out of space.
+*/
+static void *node_alloc(queue_t *q, size_t size)
+{
+    return q->pooled ? pool_alloc(&q->pool, size) : malloc(size);
+}
+
+static void node_release(queue_t *q, void *b, size_t size)
+{
+    if (q->pooled)
+        pool_release(&q->pool, b, size);
+    else
+        free(b);
+}
+
+/* Bytes taken by element e and its string */
+static size_t element_size(list_ele_t *e)
+{
+    return offsetof(list_ele_t, data) + strlen(e->data) + 1;
+}
+
+/*
+  Copy s, which takes len bytes with its terminator, into a newly
+  allocated string.  Return NULL if out of space.
+*/
+static char *copy_string(queue_t *q, char *s, size_t len)
+{
+    char *copy = node_alloc(q, len);
+    if (copy != NULL)
+        memcpy(copy, s, len);
+    return copy;
+}
+
+/*
+  Allocate a list element with a copy of s (len bytes, with its
+  terminator) stored inline after it, so that an insert makes one
+  allocation rather than two.
+  Return NULL if out of space.
+*/
+static list_ele_t *new_element(queue_t *q, char *s, size_t len)
+{
+    list_ele_t *e = node_alloc(q, offsetof(list_ele_t, data) + len);
+    if (e == NULL)
+        return NULL;
+    e->value = e->data;
+    memcpy(e->data, s, len);
+    return e;
+}
+
 /*
   Create empty queue.
   Return NULL if could not allocate space.
@@ -30,6 +104,11 @@ queue_t *q_new() //DONE
     q->head = NULL; //sets head and tail to null
     q->tail = NULL;
     q->size = 0; //sets initial size to 0
+    q->unrolled = queue_unrolled;
+    q->chead = NULL;
+    q->ctail = NULL;
+    q->pooled = queue_pooled;
+    if(q->pooled) memset(&q->pool, 0, sizeof(q->pool)); //empty pool, slabs come with the first inserts
     return q;
 
 }
@@ -42,13 +121,21 @@ void q_free(queue_t *q) //DONE
     if(q == NULL){  //if the current queue is null, return
      return;
    }
+   if(q->unrolled){
+     uq_free(q);
+     return;
+   }
+   if(q->pooled){ //the elements all live in the pool's slabs
+     pool_destroy(&q->pool);
+     free(q);
+     return;
+   }
    list_ele_t *curr = q->head;  //set curr equal to q.head
    list_ele_t *temp = NULL;  //initialize this to NULL (temp node)
    while(curr != NULL) { // we want to get through all iterations of Queue until the end
       temp = curr; //set temp list element fo be freed
       curr = curr->next; //iterate one over
-      free(temp->value); //free the value
-      free(temp);  //free the element itself
+      free(temp);  //free the element itself (the value lives inside it)
     }
   free(q);
 }
@@ -66,15 +153,9 @@ bool q_insert_head(queue_t *q, char *s) //DONE
 /* What if either call to malloc returns NULL? */
 
   if(q == NULL) return false; //if null return false
-  list_ele_t *newHead = malloc(sizeof(list_ele_t));  //allocate space
+  if(q->unrolled) return uq_insert_head_n(q, s, strlen(s) + 1, 1) == 1;
+  list_ele_t *newHead = new_element(q, s, strlen(s) + 1);  //allocate space for the element and the string in one go
   if(newHead == NULL) return false; //if malloc call =null return false
-  //newHead.value = malloc(strlens(s+1));
-  newHead->value = malloc(strlen(s) + 1);  //allocate one extra space for new head
-  if(newHead->value == NULL) { //if malloc call =null free room & return false
-    free(newHead);
-    return false;
-  }
-  strcpy(newHead->value, s); //copy string S to address of allocated malloc
 
   if(q->size == 0){ //if first element than the element is both head/tail at same time
       q->tail = newHead;
@@ -99,14 +180,9 @@ bool q_insert_tail(queue_t *q, char *s) //NEED TO DO
     /* You need to write the complete code for this function */
     /* Remember: It should operate in O(1) time */
     if(q == NULL) return false; //if null return false
-    list_ele_t *newTail = malloc(sizeof(list_ele_t));  //allocate space
+    if(q->unrolled) return uq_insert_tail_n(q, s, strlen(s) + 1, 1) == 1;
+    list_ele_t *newTail = new_element(q, s, strlen(s) + 1);  //allocate space for the element and the string
     if(newTail == NULL) return false; //if call to malloc returned NULL, then return false
-    newTail->value = malloc(strlen(s) + 1); //allocate space for the new element
-    if(newTail->value == NULL){ //if call to malloc w/ new space returned NULL, then return false
-      free(newTail);
-      return false;
-    }
-    strcpy(newTail->value, s);
     //up until here q_insert_head was pretty much the same
     //the logic here is a bit different since we are inserting a tail rather than head
     newTail->next = NULL; //set the new tail element's next to null since we are inserting tail
@@ -140,17 +216,19 @@ bool q_remove_head(queue_t *q, char *sp, size_t bufsize) //TO DO
 {
     /* You need to fix up this code. */
     // /* You need to fix up this code. */
-    if(q == NULL || q->size == 0 || sp == NULL) {
+    if(q == NULL || q->size == 0) {
           return false;
       }
+    if(q->unrolled) return uq_remove_head_n(q, sp, bufsize, 1) == 1;
     list_ele_t *removeHead = q->head;
     char *removedWord = removeHead->value;
-    int max = bufsize-1;
-    memcpy(sp, removedWord, max); //num bytes from the location pointed to by source directly to the memory block pointed to by destination.
-    sp[max] = '\0'; //termination string
+    if(sp != NULL && bufsize > 0) { //the caller may not want the string
+      strncpy(sp, removedWord, bufsize - 1); //stops at the end of the string, so we never read past it
+      sp[bufsize - 1] = '\0'; //termination string
+    }
     q->head = q->head->next; //set head.next to new head since ready for removal
-    free(removedWord); //freeing removedWord
-    free(removeHead);  //freeing space
+    if(q->head == NULL) q->tail = NULL; //removed the last element
+    node_release(q, removeHead, element_size(removeHead));  //freeing space (removedWord goes with it)
     q->size--; //we have to decrement this time because removing
     return true; //succesfully removed
 }
@@ -183,6 +261,10 @@ void q_reverse(queue_t *q) //TODO
    if(q == NULL || q->size == 0){
      return;
    }
+   if(q->unrolled){
+     uq_reverse(q);
+     return;
+   }
 
    q->tail = q->head; //set tail to head
    list_ele_t *temp = q->head->next;
@@ -196,3 +278,456 @@ void q_reverse(queue_t *q) //TODO
 
    return;
 }
+
+/*
+  Bulk operations.
+  These build (or unlink) a run of elements on their own and then
+  attach it to the queue in one step, rather than updating the queue
+  once per element.
+ */
+
+int q_insert_head_n(queue_t *q, char *s, int n)
+{
+    list_ele_t *first = NULL;
+    list_ele_t *last = NULL;
+    list_ele_t *e;
+    size_t len;
+    int done;
+    if (q == NULL || n <= 0)
+        return 0;
+    len = strlen(s) + 1;
+    if (q->unrolled)
+        return uq_insert_head_n(q, s, len, n);
+    for (done = 0; done < n; done++) {
+        if ((e = new_element(q, s, len)) == NULL)
+            break;
+        e->next = first;
+        first = e;
+        if (last == NULL)
+            last = e;
+    }
+    if (done == 0)
+        return 0;
+    last->next = q->head;
+    q->head = first;
+    if (q->tail == NULL)
+        q->tail = last;
+    q->size += done;
+    return done;
+}
+
+int q_insert_tail_n(queue_t *q, char *s, int n)
+{
+    list_ele_t *first = NULL;
+    list_ele_t *last = NULL;
+    list_ele_t *e;
+    size_t len;
+    int done;
+    if (q == NULL || n <= 0)
+        return 0;
+    len = strlen(s) + 1;
+    if (q->unrolled)
+        return uq_insert_tail_n(q, s, len, n);
+    for (done = 0; done < n; done++) {
+        if ((e = new_element(q, s, len)) == NULL)
+            break;
+        if (last)
+            last->next = e;
+        else
+            first = e;
+        last = e;
+    }
+    if (done == 0)
+        return 0;
+    last->next = NULL;
+    if (q->tail)
+        q->tail->next = first;
+    else
+        q->head = first;
+    q->tail = last;
+    q->size += done;
+    return done;
+}
+
+int q_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n)
+{
+    list_ele_t *e = NULL;
+    list_ele_t *next;
+    int done;
+    if (q == NULL || n <= 0)
+        return 0;
+    if (n > q->size)
+        n = q->size;
+    if (q->unrolled)
+        return uq_remove_head_n(q, sp, bufsize, n);
+    for (done = 0, e = q->head; done < n; done++, e = next) {
+        if (sp != NULL && bufsize > 0) {
+            strncpy(sp, e->value, bufsize - 1);
+            sp[bufsize - 1] = '\0';
+            sp += bufsize;
+        }
+        next = e->next;
+        node_release(q, e, element_size(e));
+    }
+    q->head = e;
+    if (q->head == NULL)
+        q->tail = NULL;
+    q->size -= done;
+    return done;
+}
+
+bool q_splice(queue_t *q, queue_t *q2)
+{
+    if (q == NULL || q2 == NULL || q == q2)
+        return false;
+    if (q->unrolled != q2->unrolled || q->pooled != q2->pooled)
+        return false;
+    if (q->pooled)
+        pool_splice(&q->pool, &q2->pool);
+    if (q2->size == 0)
+        return true;
+    if (q->unrolled) {
+        uq_splice(q, q2);
+        return true;
+    }
+    if (q->tail)
+        q->tail->next = q2->head;
+    else
+        q->head = q2->head;
+    q->tail = q2->tail;
+    q->size += q2->size;
+    q2->head = NULL;
+    q2->tail = NULL;
+    q2->size = 0;
+    return true;
+}
+
+/*
+  Inspecting a queue
+ */
+char *q_peek_head(queue_t *q)
+{
+    if (q == NULL || q->size == 0)
+        return NULL;
+    if (q->unrolled)
+        return q->chead->values[q->chead->start];
+    return q->head->value;
+}
+
+char *q_peek_tail(queue_t *q)
+{
+    if (q == NULL || q->size == 0)
+        return NULL;
+    if (q->unrolled)
+        return q->ctail->values[q->ctail->end - 1];
+    return q->tail->value;
+}
+
+void q_iter_init(q_iter_t *it, queue_t *q)
+{
+    it->ele = NULL;
+    it->chunk = NULL;
+    it->slot = 0;
+    if (q == NULL)
+        return;
+    if (q->unrolled) {
+        it->chunk = q->chead;
+        it->slot = q->chead ? q->chead->start : 0;
+    } else {
+        it->ele = q->head;
+    }
+}
+
+char *q_iter_next(q_iter_t *it)
+{
+    char *value;
+    if (it->ele) {
+        value = it->ele->value;
+        it->ele = it->ele->next;
+        return value;
+    }
+    if (it->chunk == NULL)
+        return NULL;
+    value = it->chunk->values[it->slot++];
+    if (it->slot == it->chunk->end) {
+        it->chunk = it->chunk->next;
+        it->slot = it->chunk ? it->chunk->start : 0;
+    }
+    return value;
+}
+
+/*
+  Unrolled representation.
+  Every chunk on the list holds at least one string.  Head inserts fill
+  the first chunk from the back, and tail inserts fill the last chunk
+  from the front, so a queue built from one end is densely packed.
+ */
+
+/* Allocate an empty chunk whose strings will start at slot */
+static list_chunk_t *new_chunk(int slot)
+{
+    list_chunk_t *c = malloc(sizeof(list_chunk_t));
+    if (c == NULL)
+        return NULL;
+    c->next = NULL;
+    c->start = slot;
+    c->end = slot;
+    return c;
+}
+
+static void uq_free(queue_t *q)
+{
+    list_chunk_t *c = q->chead;
+    list_chunk_t *next;
+    int i;
+    while (c != NULL) {
+        if (!q->pooled)
+            for (i = c->start; i < c->end; i++)
+                free(c->values[i]);
+        next = c->next;
+        free(c);
+        c = next;
+    }
+    if (q->pooled)
+        pool_destroy(&q->pool);
+    free(q);
+}
+
+/*
+  Insert n copies of s (len bytes each) at the head (tail) of the
+  queue, filling each chunk before starting another.  Each string is
+  allocated before any chunk it needs, so a failure never leaves an
+  empty chunk on the list.  Return the number inserted.
+ */
+static int uq_insert_head_n(queue_t *q, char *s, size_t len, int n)
+{
+    list_chunk_t *c = q->chead;
+    char *value;
+    int done;
+    for (done = 0; done < n; done++) {
+        if ((value = copy_string(q, s, len)) == NULL)
+            break;
+        if (c == NULL || c->start == 0) {
+            c = new_chunk(QCHUNK);
+            if (c == NULL) {
+                node_release(q, value, len);
+                break;
+            }
+            c->next = q->chead;
+            q->chead = c;
+            if (q->ctail == NULL)
+                q->ctail = c;
+        }
+        c->values[--c->start] = value;
+    }
+    q->size += done;
+    return done;
+}
+
+static int uq_insert_tail_n(queue_t *q, char *s, size_t len, int n)
+{
+    list_chunk_t *c = q->ctail;
+    char *value;
+    int done;
+    for (done = 0; done < n; done++) {
+        if ((value = copy_string(q, s, len)) == NULL)
+            break;
+        if (c == NULL || c->end == QCHUNK) {
+            c = new_chunk(0);
+            if (c == NULL) {
+                node_release(q, value, len);
+                break;
+            }
+            if (q->ctail)
+                q->ctail->next = c;
+            else
+                q->chead = c;
+            q->ctail = c;
+        }
+        c->values[c->end++] = value;
+    }
+    q->size += done;
+    return done;
+}
+
+/* Remove n (no more than the size) strings from the head */
+static int uq_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n)
+{
+    list_chunk_t *c = q->chead;
+    char *value;
+    int done;
+    for (done = 0; done < n; done++) {
+        value = c->values[c->start++];
+        if (sp != NULL && bufsize > 0) {
+            strncpy(sp, value, bufsize - 1);
+            sp[bufsize - 1] = '\0';
+            sp += bufsize;
+        }
+        node_release(q, value, strlen(value) + 1);
+        if (c->start == c->end) {
+            q->chead = c->next;
+            free(c);
+            c = q->chead;
+        }
+    }
+    if (q->chead == NULL)
+        q->ctail = NULL;
+    q->size -= done;
+    return done;
+}
+
+/* Move the chunks of q2, which is not empty, to the tail of q */
+static void uq_splice(queue_t *q, queue_t *q2)
+{
+    if (q->ctail)
+        q->ctail->next = q2->chead;
+    else
+        q->chead = q2->chead;
+    q->ctail = q2->ctail;
+    q->size += q2->size;
+    q2->chead = NULL;
+    q2->ctail = NULL;
+    q2->size = 0;
+}
+
+/* Reverse the chunk list, and the strings within each chunk */
+static void uq_reverse(queue_t *q)
+{
+    list_chunk_t *c = q->chead;
+    list_chunk_t *prev = NULL;
+    list_chunk_t *next;
+    char *tmp;
+    int i, j;
+    q->ctail = c;
+    while (c != NULL) {
+        for (i = c->start, j = c->end - 1; i < j; i++, j--) {
+            tmp = c->values[i];
+            c->values[i] = c->values[j];
+            c->values[j] = tmp;
+        }
+        next = c->next;
+        c->next = prev;
+        prev = c;
+        c = next;
+    }
+    q->chead = prev;
+}
+
+/*
+  Node pool.
+  Each slab is carved, front to back, into blocks of a single class;
+  released blocks are pushed on their class's free list and reused
+  before any more of a slab is carved.  Slabs come from malloc, so
+  the harness can make them fail like any other allocation.
+ */
+
+/* Return the smallest class holding size bytes, or -1 if none does */
+static int pool_class(size_t size)
+{
+    int c;
+    if (size <= QPOOL_MIN)
+        return 0;
+    /* ceil(log2(size)) - log2(QPOOL_MIN) */
+    c = 8 * sizeof(long) - __builtin_clzl(size - 1) - __builtin_ctz(QPOOL_MIN);
+    return c < QPOOL_CLASSES ? c : -1;
+}
+
+static void *pool_alloc(q_pool_t *p, size_t size)
+{
+    int c = pool_class(size);
+    list_slab_t *s;
+    list_big_t *big;
+    void *b;
+    if (c < 0) {
+        big = malloc(sizeof(list_big_t) + size);
+        if (big == NULL)
+            return NULL;
+        big->prev = NULL;
+        big->next = p->big;
+        if (p->big)
+            p->big->prev = big;
+        else
+            p->big_last = big;
+        p->big = big;
+        return big->mem;
+    }
+    if ((b = p->free[c]) != NULL) {
+        p->free[c] = *(void **)b;
+        return b;
+    }
+    if (p->next[c] == p->limit[c]) {
+        s = malloc(sizeof(list_slab_t) + QSLAB_BYTES);
+        if (s == NULL)
+            return NULL;
+        s->next = p->slabs;
+        if (p->slabs == NULL)
+            p->slabs_last = s;
+        p->slabs = s;
+        p->next[c] = s->mem;
+        p->limit[c] = s->mem + QSLAB_BYTES;
+    }
+    b = p->next[c];
+    p->next[c] += (size_t)QPOOL_MIN << c;
+    return b;
+}
+
+/* Give back block b, which was allocated with the same size */
+static void pool_release(q_pool_t *p, void *b, size_t size)
+{
+    int c = pool_class(size);
+    list_big_t *big;
+    if (c < 0) {
+        big = (list_big_t *)((char *)b - offsetof(list_big_t, mem));
+        if (big->prev)
+            big->prev->next = big->next;
+        else
+            p->big = big->next;
+        if (big->next)
+            big->next->prev = big->prev;
+        else
+            p->big_last = big->prev;
+        free(big);
+        return;
+    }
+    *(void **)b = p->free[c];
+    p->free[c] = b;
+}
+
+/* Free every slab and large block, whether or not it is in use */
+static void pool_destroy(q_pool_t *p)
+{
+    list_slab_t *s, *snext;
+    list_big_t *big, *bnext;
+    for (s = p->slabs; s != NULL; s = snext) {
+        snext = s->next;
+        free(s);
+    }
+    for (big = p->big; big != NULL; big = bnext) {
+        bnext = big->next;
+        free(big);
+    }
+}
+
+/*
+  Hand every slab and large block of p2 over to p, leaving p2 empty.
+  Blocks on p2's free lists, and the uncarved rest of its slabs, are
+  not reused; they go back with the slabs when p is destroyed.
+ */
+static void pool_splice(q_pool_t *p, q_pool_t *p2)
+{
+    if (p2->slabs) {
+        p2->slabs_last->next = p->slabs;
+        if (p->slabs == NULL)
+            p->slabs_last = p2->slabs_last;
+        p->slabs = p2->slabs;
+    }
+    if (p2->big) {
+        p2->big_last->next = p->big;
+        if (p->big)
+            p->big->prev = p2->big_last;
+        else
+            p->big_last = p2->big_last;
+        p->big = p2->big;
+    }
+    memset(p2, 0, sizeof(*p2));
+}
@@ -7,30 +7,96 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a singly-linked list to represent the set of queue elements,
+ * or, for queues created while queue_unrolled is set, an unrolled list:
+ * a linked list of chunks, each holding up to QCHUNK string pointers.
+ * Queues created while queue_pooled is set take their elements and
+ * strings from a pool of their own instead of calling malloc for each.
  */
 
 #include <stdbool.h>
 
 /************** Data structure declarations ****************/
 
-/* Linked list element (You shouldn't need to change this) */
+/* Linked list element */
 typedef struct ELE {
     /* Pointer to array holding string.
-       This array needs to be explicitly allocated and freed */
+       This points at data, below, so it is freed along with the element */
     char *value;
     struct ELE *next;
+    /* The string itself, allocated in one block with the element */
+    char data[];
 } list_ele_t;
 
+/* Strings per chunk of an unrolled queue */
+#define QCHUNK 64
+
+/* Chunk of an unrolled queue.  Its strings are values[start..end-1] */
+typedef struct CHUNK {
+    struct CHUNK *next;
+    int start;
+    int end;
+    char *values[QCHUNK];
+} list_chunk_t;
+
+/* Node pool.
+   Blocks of up to QPOOL_MIN << (QPOOL_CLASSES-1) bytes are carved from
+   QSLAB_BYTES slabs, one size class (a power of two) per slab, and go
+   on a free list for their class when released.  Larger blocks are
+   malloc'd singly and kept on a list, so the pool can free everything
+   without looking at the blocks that are in use. */
+#define QPOOL_MIN 16
+#define QPOOL_CLASSES 6
+#define QSLAB_BYTES 8192
+
+typedef struct SLAB {
+    struct SLAB *next;
+    size_t pad;        /* keeps mem 16-byte aligned */
+    char mem[];
+} list_slab_t;
+
+typedef struct BIG {
+    struct BIG *next;
+    struct BIG *prev;
+    char mem[];
+} list_big_t;
+
+typedef struct {
+    list_slab_t *slabs;           /* Every slab the pool has */
+    list_slab_t *slabs_last;
+    void *free[QPOOL_CLASSES];    /* Released blocks of each class */
+    char *next[QPOOL_CLASSES];    /* Uncarved part of the newest slab */
+    char *limit[QPOOL_CLASSES];   /* of each class */
+    list_big_t *big;              /* Blocks too large for any class */
+    list_big_t *big_last;
+} q_pool_t;
+
 /* Queue structure */
 typedef struct {
     list_ele_t *head;  /* Linked list of elements */
-    /*
-      You will need to add more fields to this structure
-      to efficiently implement q_size and q_insert_tail
-    */
+    list_ele_t *tail;  /* Last element, for O(1) q_insert_tail */
+    int size;          /* Number of elements, for O(1) q_size */
+    /* Unrolled representation, used instead of head/tail if set */
+    bool unrolled;
+    list_chunk_t *chead;
+    list_chunk_t *ctail;
+    /* Node pool, used instead of malloc and free if set */
+    bool pooled;
+    q_pool_t pool;
 } queue_t;
 
+/*
+  If nonzero, q_new creates unrolled queues.
+  The q_* functions work the same either way.
+*/
+extern int queue_unrolled;
+
+/*
+  If nonzero, q_new creates queues with a node pool, which q_free
+  releases a slab at a time.
+*/
+extern int queue_pooled;
+
 /************** Operations on queue ************************/
 
 /*
@@ -87,3 +153,64 @@ int q_size(queue_t *q);
   It should rearrange the existing ones.
  */
 void q_reverse(queue_t *q);
+
+/************** Bulk operations ***************************/
+
+/*
+  Insert n copies of string s at head (tail) of queue.
+  Return the number inserted, which is less than n only if q is NULL
+  or space ran out; the copies that were inserted stay in the queue.
+ */
+int q_insert_head_n(queue_t *q, char *s, int n);
+int q_insert_tail_n(queue_t *q, char *s, int n);
+
+/*
+  Remove up to n elements from head of queue.
+  Return the number removed, which is less than n only if the queue
+  runs out.
+  If sp is non-NULL, the i'th removed string is copied to sp + i*bufsize
+  as q_remove_head would copy it to sp, so sp must have room for n
+  strings of bufsize bytes.
+ */
+int q_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n);
+
+/*
+  Move all elements of q2 to the tail of q in O(1) time, leaving q2
+  empty (it must still be freed with q_free).
+  Return false, changing nothing, if either is NULL, they are the same
+  queue, or they were created with different representations or
+  pooling.
+ */
+bool q_splice(queue_t *q, queue_t *q2);
+
+/************** Inspecting a queue ************************/
+
+/*
+  These let qtest look at a queue without knowing its representation.
+  None of them allocate or free anything.
+*/
+
+/*
+  Return the string at the head (or tail) of the queue, without
+  removing it.
+  Return NULL if q is NULL or empty.
+ */
+char *q_peek_head(queue_t *q);
+char *q_peek_tail(queue_t *q);
+
+/* Position in a queue, for walking it from head to tail */
+typedef struct {
+    list_ele_t *ele;      /* Next element (linked list) */
+    list_chunk_t *chunk;  /* Next chunk and slot in it (unrolled) */
+    int slot;
+} q_iter_t;
+
+/*
+  Start walking q from its head.  q may be NULL.
+ */
+void q_iter_init(q_iter_t *it, queue_t *q);
+
+/*
+  Return the next string in the queue, or NULL past the tail.
+ */
+char *q_iter_next(q_iter_t *it);
@@ -0,0 +1,23 @@
+# Test of splice onto empty and non-empty queues, and of splicing nothing
+option fail 0
+option malloc 0
+new
+splice dolphin 3
+size
+rh dolphin
+ih bear
+it gerbil
+splice meerkat 2
+splice vulture 0
+size
+rh bear
+rh dolphin
+rh dolphin
+rh gerbil
+rh meerkat
+rh meerkat
+size
+splice squirrel 0
+size
+splice vulture
+rh vulture
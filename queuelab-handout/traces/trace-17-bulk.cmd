@@ -0,0 +1,17 @@
+# Test of bulk insert and remove, removing more than the queue holds
+option fail 30
+option malloc 0
+new
+ih dolphin 5
+it gerbil 5
+rhq 4
+size
+rh dolphin
+rh gerbil
+rhq 20
+size
+ih bear 3
+rhq 3
+size
+rhq 3
+size
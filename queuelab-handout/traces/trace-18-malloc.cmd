@@ -0,0 +1,14 @@
+# Test of bulk insert, splice and bulk remove with malloc failure
+option fail 100
+option malloc 0
+new
+option malloc 25
+ih jaguar 20
+it gerbil 20
+splice meerkat 10
+splice squirrel 10
+option malloc 0
+size
+rhq 70
+size
+free
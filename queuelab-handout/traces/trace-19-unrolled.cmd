@@ -0,0 +1,34 @@
+# Test of an unrolled queue, across chunk boundaries and with malloc failure
+option fail 100
+option malloc 0
+option unrolled 1
+new
+ih dolphin
+ih bear
+it gerbil
+reverse
+rh gerbil
+rh dolphin
+rh bear
+size
+ih meerkat 70
+it vulture 70
+size
+reverse
+rh vulture
+rhq 68
+rh vulture
+rh meerkat
+splice squirrel 100
+size
+reverse
+rh squirrel
+rhq 99
+size
+option malloc 25
+ih jaguar 150
+it gerbil 150
+option malloc 0
+size
+free
+option unrolled 0
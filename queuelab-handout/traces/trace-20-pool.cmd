@@ -0,0 +1,39 @@
+# Test of queues with a node pool, linked and unrolled, with malloc failure
+option fail 100
+option malloc 0
+option pool 1
+new
+ih dolphin
+ih bear
+it gerbil
+reverse
+rh gerbil
+rh dolphin
+rh bear
+ih meerkat 50
+rhq 50
+it vulture 50
+size
+rh vulture
+splice squirrel 20
+option malloc 25
+ih jaguar 50
+it gerbil 50
+option malloc 0
+size
+free
+option unrolled 1
+new
+ih meerkat 70
+it vulture 70
+rhq 100
+reverse
+rh vulture
+size
+option malloc 25
+it jaguar 100
+option malloc 0
+size
+free
+option unrolled 0
+option pool 0